@@ -0,0 +1,609 @@
+/*
+ * Cache of the compiled crontabs, so that crond does not parse every
+ * crontab again when it starts.
+ *
+ * For each crontab the cache file keeps the environment settings and
+ * the schedules of the entries as load_user() found them, in the order
+ * they came.  A record is keyed by the tabname, the identity of the file
+ * (device, inode, size, times of modification and change) and a hash of
+ * its contents.  A crontab whose file is the same is not even read; one
+ * with the same contents is read and hashed, but not parsed.
+ *
+ * What depends on more than the crontab is worked out again from the
+ * record: the passwd entry of the owner, CRON_TZ, RANDOM_DELAY and the
+ * environment of the jobs.  Errors in a crontab are only logged when it
+ * is parsed, the entries in error are not in the record.
+ *
+ * The file is read at the start of each load of the database and written
+ * again at its end if any crontab was parsed or dropped.  It is native
+ * endian and meant for the crond that wrote it; if anything is wrong
+ * with it, it is ignored and written anew.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "funcs.h"
+#include "globals.h"
+#include "pathnames.h"
+
+#define CACHE_VERSION	1
+#define ALIGN8(n)	(((n) + 7) & ~(size_t) 7)
+
+#define ITEM_ENV	1	/* followed by the NAME=VALUE string */
+#define ITEM_ENTRY	2	/* cache_sched, command, user of a system crontab */
+
+static const char cache_magic[8] = { 'C', 'R', 'O', 'N', 'D', 'C', 'C', 'H' };
+
+typedef struct _cache_head {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	layout;		/* sizeof (cache_sched) */
+	uint64_t	size;		/* of the file */
+} cache_head;
+
+typedef struct _cache_key {
+	uint64_t	dev, ino, size;
+	int64_t		mtime, mtime_ns, ctime, ctime_ns;
+	uint64_t	hash;		/* of the contents */
+} cache_key;
+
+	/* a record starts with this, followed by the tabname and the items */
+typedef struct _cache_rhead {
+	uint32_t	len;		/* of the record, a multiple of 8 */
+	uint32_t	pathlen;	/* of the tabname with its NUL */
+	uint32_t	system;
+	uint32_t	pad;
+	cache_key	key;
+} cache_rhead;
+
+typedef struct _cache_item {
+	uint32_t	type;
+	uint32_t	len;		/* with this header, before padding */
+} cache_item;
+
+typedef struct _cache_sched {
+	bitstr_t	bit_decl(second, SECOND_COUNT);
+	bitstr_t	bit_decl(minute, MINUTE_COUNT);
+	bitstr_t	bit_decl(hour,   HOUR_COUNT);
+	bitstr_t	bit_decl(dom,    DOM_COUNT);
+	bitstr_t	bit_decl(month,  MONTH_COUNT);
+	bitstr_t	bit_decl(dow,    DOW_COUNT);
+	int32_t		flags;
+} cache_sched;
+
+struct _cache_rec {
+	struct _cache_rec	*next;	/* hash chain of the mapped records */
+	char		*data;		/* starts with a cache_rhead */
+	size_t		size;		/* allocated, 0 if in the mapped file */
+};
+
+static char *map;		/* the cache file read, or NULL */
+static size_t map_size;
+static cache_rec *recs, **buckets;
+static int nrecs, nbuckets;
+
+static unsigned hash_path(const char *s) {
+	unsigned h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return (h);
+}
+
+static void make_key(cache_key *k, const struct stat *st) {
+	memset(k, 0, sizeof (*k));
+	k->dev = (uint64_t) st->st_dev;
+	k->ino = (uint64_t) st->st_ino;
+	k->size = (uint64_t) st->st_size;
+	k->mtime = (int64_t) st->st_mtim.tv_sec;
+	k->mtime_ns = (int64_t) st->st_mtim.tv_nsec;
+	k->ctime = (int64_t) st->st_ctim.tv_sec;
+	k->ctime_ns = (int64_t) st->st_ctim.tv_nsec;
+}
+
+static int same_file(const cache_key *a, const cache_key *b) {
+	return (a->dev == b->dev && a->ino == b->ino && a->size == b->size &&
+		a->mtime == b->mtime && a->mtime_ns == b->mtime_ns &&
+		a->ctime == b->ctime && a->ctime_ns == b->ctime_ns);
+}
+
+static const char *rec_path(const cache_rec *r) {
+	return (r->data + sizeof (cache_rhead));
+}
+
+static const char *rec_items(const cache_rec *r) {
+	cache_rhead h;
+
+	memcpy(&h, r->data, sizeof h);
+	return (r->data + ALIGN8(sizeof h + h.pathlen));
+}
+
+static const cache_rec *find_rec(const char *tabname) {
+	const cache_rec *r;
+
+	if (nbuckets == 0)
+		return (NULL);
+	for (r = buckets[hash_path(tabname) % (unsigned) nbuckets]; r != NULL;
+		r = r->next)
+		if (strcmp(rec_path(r), tabname) == 0)
+			return (r);
+	return (NULL);
+}
+
+/*
+ * Check the items of a record, from p to end.
+ */
+static int valid_items(const char *p, const char *end) {
+	cache_item it;
+	const char *s, *last;
+
+	while (p < end) {
+		if ((size_t) (end - p) < sizeof it)
+			return (FALSE);
+		memcpy(&it, p, sizeof it);
+		if (it.len < sizeof it || it.len > (size_t) (end - p))
+			return (FALSE);
+		s = p + sizeof it;
+		last = p + it.len;
+		switch (it.type) {
+		case ITEM_ENV:
+			if (s == last || last[-1] != '\0')
+				return (FALSE);
+			break;
+		case ITEM_ENTRY:
+			if ((size_t) (last - s) < sizeof (cache_sched) + 2)
+				return (FALSE);
+			s += sizeof (cache_sched);
+			if ((s = memchr(s, '\0', (size_t) (last - s))) == NULL ||
+				last[-1] != '\0' || s == last - 1)
+				return (FALSE);
+			break;
+		default:
+			return (FALSE);
+		}
+		if (ALIGN8(it.len) > (size_t) (end - p))
+			return (FALSE);
+		p += ALIGN8(it.len);
+	}
+	return (TRUE);
+}
+
+/*
+ * Check the mapped file and count its records.
+ */
+static int valid_map(void) {
+	cache_head head;
+	cache_rhead h;
+	size_t off;
+
+	if (map_size < sizeof head)
+		return (FALSE);
+	memcpy(&head, map, sizeof head);
+	if (memcmp(head.magic, cache_magic, sizeof head.magic) != 0 ||
+		head.version != CACHE_VERSION ||
+		head.layout != sizeof (cache_sched) || head.size != map_size)
+		return (FALSE);
+
+	nrecs = 0;
+	for (off = sizeof head; off < map_size; off += h.len) {
+		if (map_size - off < sizeof h)
+			return (FALSE);
+		memcpy(&h, map + off, sizeof h);
+		if (h.len % 8 != 0 || h.len > map_size - off || h.pathlen == 0 ||
+			ALIGN8(sizeof h + h.pathlen) > h.len ||
+			map[off + sizeof h + h.pathlen - 1] != '\0' ||
+			strlen(map + off + sizeof h) != h.pathlen - 1 ||
+			!valid_items(map + off + ALIGN8(sizeof h + h.pathlen),
+				map + off + h.len))
+			return (FALSE);
+		nrecs++;
+	}
+	return (TRUE);
+}
+
+static void unmap_cache(void) {
+	if (map != NULL)
+		munmap(map, map_size);
+	map = NULL;
+	map_size = 0;
+	free(recs);
+	free(buckets);
+	recs = NULL;
+	buckets = NULL;
+	nrecs = nbuckets = 0;
+}
+
+/*
+ * Read the cache file, before a load of the database.
+ */
+void cache_begin(void) {
+	struct stat st;
+	cache_rhead h;
+	cache_rec *r;
+	size_t off;
+	unsigned b;
+	int fd;
+
+	unmap_cache();
+	if ((fd = open(CRON_CACHE, O_RDONLY | O_CLOEXEC)) < 0)
+		return;
+	if (fstat(fd, &st) < 0 || st.st_size <= 0 || st.st_uid != geteuid()) {
+		close(fd);
+		return;
+	}
+	map_size = (size_t) st.st_size;
+	map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		map_size = 0;
+		return;
+	}
+
+	if (!valid_map()) {
+		Debug(DLOAD, ("[%ld] ignoring bad %s\n", (long) getpid(),
+				CRON_CACHE));
+		unmap_cache();
+		return;
+	}
+	if (nrecs == 0)
+		return;
+	nbuckets = nrecs * 2 + 1;
+	recs = calloc((size_t) nrecs, sizeof (*recs));
+	buckets = calloc((size_t) nbuckets, sizeof (*buckets));
+	if (recs == NULL || buckets == NULL) {
+		unmap_cache();
+		return;
+	}
+	for (r = recs, off = sizeof (cache_head); off < map_size; off += h.len,
+		r++) {
+		memcpy(&h, map + off, sizeof h);
+		r->data = map + off;
+		b = hash_path(rec_path(r)) % (unsigned) nbuckets;
+		r->next = buckets[b];
+		buckets[b] = r;
+	}
+	Debug(DLOAD, ("[%ld] %d crontabs in %s\n", (long) getpid(), nrecs,
+			CRON_CACHE));
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, p, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (FALSE);
+		}
+		p += n;
+		len -= (size_t) n;
+	}
+	return (TRUE);
+}
+
+/*
+ * The record to write for u: the one of its last parse, or the one
+ * it was loaded from.
+ */
+static const cache_rec *saved_rec(const user *u) {
+	return (u->cached != NULL ? u->cached : find_rec(u->tabname));
+}
+
+static int save_cache(cron_db *db) {
+	char tmp[MAX_FNAME];
+	cache_head head;
+	const cache_rec *r;
+	cache_rhead h;
+	user *u;
+	int fd, ok;
+
+	memset(&head, 0, sizeof head);
+	memcpy(head.magic, cache_magic, sizeof head.magic);
+	head.version = CACHE_VERSION;
+	head.layout = sizeof (cache_sched);
+	head.size = sizeof head;
+	for (u = db->head; u != NULL; u = u->next)
+		if ((r = saved_rec(u)) != NULL) {
+			memcpy(&h, r->data, sizeof h);
+			head.size += h.len;
+		}
+
+	if (!glue_strings(tmp, sizeof tmp, CRON_CACHE, "XXXXXX", '.') ||
+		(fd = mkstemp(tmp)) < 0)
+		return (FALSE);
+	ok = write_all(fd, &head, sizeof head);
+	for (u = db->head; ok && u != NULL; u = u->next)
+		if ((r = saved_rec(u)) != NULL) {
+			memcpy(&h, r->data, sizeof h);
+			ok = write_all(fd, r->data, h.len);
+		}
+	if (close(fd) < 0)
+		ok = FALSE;
+	if (!ok || rename(tmp, CRON_CACHE) < 0) {
+		unlink(tmp);
+		return (FALSE);
+	}
+	Debug(DLOAD, ("[%ld] %s written\n", (long) getpid(), CRON_CACHE));
+	return (TRUE);
+}
+
+/*
+ * Write the cache file for db if it changed, after a load of the database.
+ */
+void cache_end(cron_db *db) {
+	int dirty = FALSE, found = 0;
+	user *u;
+
+	for (u = db->head; u != NULL; u = u->next) {
+		if (u->cached != NULL)
+			dirty = TRUE;
+		else if (find_rec(u->tabname) != NULL)
+			found++;
+	}
+	if (dirty || found != nrecs) {
+		if (!save_cache(db))
+			Debug(DLOAD, ("[%ld] can't write %s: %s\n", (long) getpid(),
+					CRON_CACHE, strerror(errno)));
+	}
+	for (u = db->head; u != NULL; u = u->next)
+		cache_free(u);
+	unmap_cache();
+}
+
+/*
+ * Is the record of tabname good for the file stated as *st?
+ */
+int cache_fresh(const char *tabname, const struct stat *st) {
+	const cache_rec *r;
+	cache_rhead h;
+	cache_key key;
+
+	if ((r = find_rec(tabname)) == NULL)
+		return (FALSE);
+	make_key(&key, st);
+	memcpy(&h, r->data, sizeof h);
+	return (same_file(&h.key, &key));
+}
+
+static int new_rec(user *u, const cache_key *key, const cache_rec *from) {
+	cache_rhead h;
+	size_t len, pathlen;
+
+	if (from != NULL) {
+		memcpy(&h, from->data, sizeof h);
+		len = h.len;
+	}
+	else {
+		pathlen = strlen(u->tabname) + 1;
+		memset(&h, 0, sizeof h);
+		h.pathlen = (uint32_t) pathlen;
+		h.system = (uint32_t) u->system;
+		len = ALIGN8(sizeof h + pathlen);
+		h.len = (uint32_t) len;
+	}
+	h.key = *key;
+
+	if ((u->cached = calloc(1, sizeof (*u->cached))) == NULL)
+		return (FALSE);
+	u->cached->size = len < 256 ? 256 : len;
+	if ((u->cached->data = calloc(1, u->cached->size)) == NULL) {
+		cache_free(u);
+		return (FALSE);
+	}
+	if (from != NULL)
+		memcpy(u->cached->data, from->data, len);
+	else
+		memcpy(u->cached->data + sizeof h, u->tabname, h.pathlen);
+	memcpy(u->cached->data, &h, sizeof h);
+	return (TRUE);
+}
+
+/*
+ * Replay the record r into the empty u, for the owner pw (NULL for a
+ * system crontab) and the environment *envpp.  Return TRUE if done,
+ * FALSE if the record can't be used and ERR if out of memory.
+ */
+static int replay(user *u, const cache_rec *r, struct passwd *pw,
+	char ***envpp) {
+	const char *p, *end, *cmd, *uname;
+	cache_rhead h;
+	cache_item it;
+	cache_sched s;
+	char **tenvp;
+	entry *e;
+
+	memcpy(&h, r->data, sizeof h);
+	end = r->data + h.len;
+
+	/* only root may keep the jobs of a crontab from being logged */
+	for (p = rec_items(r); pw != NULL && pw->pw_uid != 0 && p < end;
+		p += ALIGN8(it.len)) {
+		memcpy(&it, p, sizeof it);
+		if (it.type != ITEM_ENTRY)
+			continue;
+		memcpy(&s, p + sizeof it, sizeof s);
+		if (s.flags & DONT_LOG)
+			return (FALSE);
+	}
+
+	for (p = rec_items(r); p < end; p += ALIGN8(it.len)) {
+		memcpy(&it, p, sizeof it);
+		if (it.type == ITEM_ENV) {
+			if ((tenvp = env_set(*envpp, p + sizeof it)) == NULL)
+				return (ERR);
+			*envpp = tenvp;
+			continue;
+		}
+		memcpy(&s, p + sizeof it, sizeof s);
+		cmd = p + sizeof it + sizeof s;
+		uname = cmd + strlen(cmd) + 1;
+		if ((e = calloc(1, sizeof (*e))) == NULL)
+			return (ERR);
+		memcpy(e->second, s.second, sizeof e->second);
+		memcpy(e->minute, s.minute, sizeof e->minute);
+		memcpy(e->hour, s.hour, sizeof e->hour);
+		memcpy(e->dom, s.dom, sizeof e->dom);
+		memcpy(e->month, s.month, sizeof e->month);
+		memcpy(e->dow, s.dow, sizeof e->dow);
+		e->flags = s.flags;
+		if ((e->cmd = strdup(cmd)) == NULL ||
+			!cached_entry(e, uname, pw, *envpp)) {
+			env_release(e->envp);
+			pw_release(e->pwd);
+			free(e->cmd);
+			free(e);
+			return (ERR);
+		}
+		e->next = u->crontab;
+		u->crontab = e;
+	}
+	return (TRUE);
+}
+
+/*
+ * Load the crontab of u, of the file st and the contents buf, from the
+ * cache.  With buf NULL, only a record of the same file is taken, and
+ * u->hash is set from it; else u->hash is that of buf.
+ * Return TRUE if loaded, FALSE if it has to be parsed and ERR if out of
+ * memory.  When it has to be parsed, a new record is started for
+ * cache_record().
+ */
+int cache_load(user *u, const struct stat *st, const cron_buf *buf,
+	struct passwd *pw, char ***envpp) {
+	const cache_rec *r;
+	cache_rhead h;
+	cache_key key;
+	int status;
+
+	make_key(&key, st);
+	if (buf != NULL)
+		key.hash = u->hash;
+	if ((r = find_rec(u->tabname)) != NULL) {
+		memcpy(&h, r->data, sizeof h);
+		if (h.system == (uint32_t) u->system && (buf == NULL ?
+				same_file(&h.key, &key) :
+				h.key.size == key.size && h.key.hash == key.hash)) {
+			if ((status = replay(u, r, pw, envpp)) != FALSE) {
+				Debug(DLOAD, ("\t%s: [cached]\n", u->tabname));
+				u->hash = h.key.hash;
+				/* the same contents under a new key */
+				if (status == TRUE && buf != NULL)
+					(void) new_rec(u, &key, r);
+				return (status);
+			}
+		}
+	}
+	if (buf != NULL)
+		(void) new_rec(u, &key, NULL);
+	return (FALSE);
+}
+
+/*
+ * u is kept for its crontab, open as fd, which was rewritten with the
+ * same contents: key its record by the file as it is now.
+ */
+void cache_rekey(user *u, int fd) {
+	const cache_rec *r;
+	struct stat st;
+	cache_rhead h;
+	cache_key key;
+
+	if ((r = saved_rec(u)) == NULL || fstat(fd, &st) < 0)
+		return;
+	make_key(&key, &st);
+	key.hash = u->hash;
+	if (u->cached != NULL) {
+		memcpy(&h, u->cached->data, sizeof h);
+		h.key = key;
+		memcpy(u->cached->data, &h, sizeof h);
+	}
+	else
+		(void) new_rec(u, &key, r);
+}
+
+/*
+ * Add the environment setting envstr or the entry e, just parsed, to the
+ * record of u.
+ */
+void cache_record(user *u, const char *envstr, const entry *e) {
+	const char *s1 = envstr, *s2 = "";
+	cache_sched s;
+	cache_rhead h;
+	cache_item it;
+	size_t len, size;
+	char *p;
+
+	if (u->cached == NULL)
+		return;
+	it.type = ITEM_ENV;
+	it.len = (uint32_t) sizeof it;
+	if (e != NULL) {
+		memset(&s, 0, sizeof s);
+		memcpy(s.second, e->second, sizeof s.second);
+		memcpy(s.minute, e->minute, sizeof s.minute);
+		memcpy(s.hour, e->hour, sizeof s.hour);
+		memcpy(s.dom, e->dom, sizeof s.dom);
+		memcpy(s.month, e->month, sizeof s.month);
+		memcpy(s.dow, e->dow, sizeof s.dow);
+		s.flags = e->flags;
+		it.type = ITEM_ENTRY;
+		it.len += (uint32_t) sizeof s;
+		s1 = e->cmd;
+		if (u->system)
+			s2 = e->pwd->pw_name;
+		it.len += (uint32_t) (strlen(s2) + 1);
+	}
+	it.len += (uint32_t) (strlen(s1) + 1);
+
+	memcpy(&h, u->cached->data, sizeof h);
+	len = ALIGN8(it.len);
+	if (h.len + len > UINT32_MAX) {
+		cache_free(u);
+		return;
+	}
+	if (h.len + len > u->cached->size) {
+		size = u->cached->size * 2;
+		while (size < h.len + len)
+			size *= 2;
+		if ((p = realloc(u->cached->data, size)) == NULL) {
+			cache_free(u);
+			return;
+		}
+		u->cached->data = p;
+		u->cached->size = size;
+	}
+	p = u->cached->data + h.len;
+	memset(p, 0, len);
+	memcpy(p, &it, sizeof it);
+	p += sizeof it;
+	if (e != NULL) {
+		memcpy(p, &s, sizeof s);
+		p += sizeof s;
+	}
+	strcpy(p, s1);
+	if (e != NULL)
+		strcpy(p + strlen(s1) + 1, s2);
+
+	h.len += (uint32_t) len;
+	memcpy(u->cached->data, &h, sizeof h);
+}
+
+void cache_free(user *u) {
+	if (u->cached == NULL)
+		return;
+	free(u->cached->data);
+	free(u->cached);
+	u->cached = NULL;
+}
@@ -30,6 +30,7 @@
 
 #include <errno.h>
 #include <langinfo.h>
+#include <limits.h>
 #include <locale.h>
 #include <pwd.h>
 #include <signal.h>
@@ -41,6 +42,26 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <fcntl.h>
+#include <time.h>
+
+#ifdef WITH_INOTIFY
+# include <sys/ioctl.h>
+#endif
+
+#if defined HAVE_SYS_EPOLL_H && defined HAVE_SYS_SIGNALFD_H && \
+	defined HAVE_SYS_TIMERFD_H
+# define WITH_EVENTS
+# include <stdint.h>
+# include <sys/epoll.h>
+# include <sys/signalfd.h>
+# include <sys/timerfd.h>
+# ifndef TFD_TIMER_CANCEL_ON_SET
+#  define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+# endif
+# ifdef HAVE_PIDFD_OPEN
+#  include <sys/pidfd.h>
+# endif
+#endif
 
 #ifdef WITH_INOTIFY
 # include <sys/inotify.h>
@@ -59,21 +80,56 @@ int inotify_enabled;
 
 enum timejump { negative, small, medium, large };
 
+	/* longest tickless sleep, so that orphans still get rechecked */
+#define MAX_IDLE_MINUTES 60
+
 static void usage(void) ATTRIBUTE_NORETURN,
 run_reboot_jobs(cron_db *),
+find_job(entry *, user *, int, int, int, long),
 find_jobs(int, cron_db *, int, int, long),
 set_time(int),
 cron_sleep(int, cron_db *),
+idle_sleep(int, cron_db *),
+wait_until(int, cron_db *),
+wait_second(int, cron_db *),
+pause_for(int, cron_db *),
+catchup_step(cron_db *),
+catchup_done(int),
+prefetch_user(entry *, user *),
 sigchld_handler(int),
 sighup_handler(int ATTRIBUTE_UNUSED),
 sigurg_handler(int ATTRIBUTE_UNUSED),
+sigio_handler(int ATTRIBUTE_UNUSED),
 sigchld_reaper(void),
 sigintterm_handler(int ATTRIBUTE_UNUSED), parse_args(int c, char *v[]);
 
+static int next_wakeup(cron_db *);
+#if defined WITH_INOTIFY
+static int events_running(void);
+#endif
+static time_t minute_start(int);
+static int run_seconds(int);
+
 static volatile sig_atomic_t got_sighup, got_sigchld, got_sigintterm, got_sigurg;
 static int timeRunning, virtualTime, clockTime;
 static long GMToff;
 static int DisableInotify;
+static int Tickless;
+static int CatchupSpacing = 10;	/* seconds between replayed minutes */
+static int CatchupLimit = 60;	/* seconds after which to stop pacing */
+static time_t catchupStart;	/* monotonic, 0 if not catching up */
+static int replayedMinutes, replayedJobs;
+
+#if defined WITH_EVENTS
+static int efd = -1, sfd = -1, tfd = -1;	/* epoll, signalfd, timerfd */
+static int events_ifd = -1;	/* inotify, if watched */
+static int reap_all;		/* some child is not watched by a pidfd */
+static int no_pidfd_wait;	/* waitid() cannot take a pidfd */
+static sigset_t event_signals, old_sigmask;
+
+static int events_init(int);
+static int event_wait(time_t, cron_db *);
+#endif
 
 #if defined WITH_INOTIFY
 
@@ -149,6 +205,31 @@ void set_cron_watched(int fd) {
 
 	inotify_enabled = 1;
 }
+
+/*
+ * Return the path watched by the watch descriptor w, or NULL.
+ */
+const char *cron_watched_path(int w) {
+	size_t i;
+
+	for (i = 0; i < sizeof (wd) / sizeof (wd[0]); ++i)
+		if (wd[i] >= 0 && wd[i] == w)
+			return (watchpaths[i]);
+	return (NULL);
+}
+
+/*
+ * Return the number of paths which could not be watched.
+ */
+int cron_watches_missing(void) {
+	size_t i;
+	int n = 0;
+
+	for (i = 0; i < sizeof (wd) / sizeof (wd[0]); ++i)
+		if (wd[i] < 0)
+			n++;
+	return (n);
+}
 #endif
 
 static void handle_signals(cron_db * database) {
@@ -186,10 +267,15 @@ static void usage(void) {
 	fprintf(stderr, " -n         run in foreground\n");
 	fprintf(stderr, " -f         run in foreground, the same as -n\n");
 	fprintf(stderr, " -p         permit any crontab\n");
+	fprintf(stderr, " -q <sec>   wait for crontab changes to settle that long (default 2)\n");
+	fprintf(stderr, " -r <sec>   without inotify, check every crontab that often (default 3600)\n");
 	fprintf(stderr, " -P         inherit PATH from environment instead of using default value");
 	fprintf(stderr, "            of \"%s\"\n", _PATH_STDPATH);
 	fprintf(stderr, " -c         enable clustering support\n");
 	fprintf(stderr, " -s         log into syslog instead of sending mails\n");
+	fprintf(stderr, " -t         sleep until the next minute with jobs to run\n");
+	fprintf(stderr, " -w <sec>   pause between missed minutes run late (default 10)\n");
+	fprintf(stderr, " -W <sec>   stop pausing after catching up that long (default 60)\n");
 	fprintf(stderr, " -V         print version and exit\n");
 	fprintf(stderr, " -x <flag>  print debug information\n");
 	fprintf(stderr, "\n");
@@ -247,6 +333,8 @@ int main(int argc, char *argv[]) {
 	(void) sigaction(SIGTERM, &sact, NULL);
 	sact.sa_handler = sigurg_handler;
 	(void) sigaction(SIGURG, &sact, NULL);
+	sact.sa_handler = sigio_handler;
+	(void) sigaction(SIGIO, &sact, NULL);
 
 	acquire_daemonlock(0);
 	set_cron_uid();
@@ -331,13 +419,31 @@ int main(int argc, char *argv[]) {
 		if (fd < 0)
 			log_it("CRON", pid, "INFO", "Inotify init failed", errno);
 		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		/* let changes interrupt idle_sleep() */
+		if (Tickless && fd >= 0 && (fcntl(fd, F_SETOWN, getpid()) < 0 ||
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_ASYNC) < 0)) {
+			log_it("CRON", pid, "INFO", "Inotify signals failed, "
+				"running without tickless mode", errno);
+			Tickless = 0;
+		}
 		set_cron_watched(fd);
 	}
 #endif
+	if (Tickless && !inotify_enabled) {
+		log_it("CRON", pid, "INFO", "Tickless mode needs inotify", 0);
+		Tickless = 0;
+	}
+
+#if defined WITH_EVENTS
+	if (!events_init(fd))
+		log_it("CRON", pid, "INFO", "running without event loop", errno);
+#endif
 
 	database.head = NULL;
 	database.tail = NULL;
 	database.mtime = (time_t) 0;
+	database.by_name = database.by_tab = NULL;
+	database.nbuckets = database.nusers = 0;
 
 	load_database(&database);
 
@@ -355,20 +461,43 @@ int main(int argc, char *argv[]) {
 	 * At the top of the loop, all jobs for 'virtualTime' have run.
 	 * timeRunning: is the time we last awakened.
 	 * clockTime: is the time when set_time was last called.
+	 * idleUntil: is the time a tickless sleep was aiming at; the
+	 * minutes before it had nothing to run.
 	 */
 	while (!got_sigintterm) {
-		int timeDiff;
+		int timeDiff, idleUntil, second;
 		enum timejump wakeupKind;
 
-		/* ... wait for the time (in minutes) to change ... */
+		/* ... wait for the time (in minutes) to change, running the
+		 * jobs with a field of seconds meanwhile ...
+		 */
 		do {
-			cron_sleep(timeRunning + 1, &database);
+			idleUntil = next_wakeup(&database);
+			if ((second = sched_seconds_next()) >= 0)
+				wait_second(second, &database);
+			else
+				wait_until(idleUntil, &database);
 			set_time(FALSE);
+			if (clockTime == timeRunning &&
+				run_seconds((int) ((StartTime + GMToff) % SECONDS_PER_MINUTE)))
+				job_runqueue();
 		} while (!got_sigintterm && clockTime == timeRunning);
 		if (got_sigintterm)
 			break;
+		/* the seconds we missed of the last minute are late */
+		if (run_seconds(LAST_SECOND))
+			job_runqueue();
+		sched_seconds_reset();
 		timeRunning = clockTime;
 
+		/* catch up from where the idle minutes end, not from where
+		 * we went to sleep
+		 */
+		if (idleUntil > timeRunning)
+			idleUntil = timeRunning;
+		if (idleUntil - 1 > virtualTime)
+			virtualTime = idleUntil - 1;
+
 		/*
 		 * Calculate how the current time differs from our virtual
 		 * clock.  Classify the change into one of 4 cases.
@@ -376,14 +505,14 @@ int main(int argc, char *argv[]) {
 		timeDiff = timeRunning - virtualTime;
 		check_orphans(&database);
 #if defined WITH_INOTIFY
-		if (inotify_enabled) {
-			check_inotify_database(&database);
-		}
-		else {
-			if (load_database(&database) && (EnableClustering != 1))
-				/* try reinstating the watches */
-				set_cron_watched(fd);
-		}
+		/* changes which have settled by now take part in this minute;
+		 * the event loop has read them as they came
+		 */
+		if (inotify_enabled)
+			check_inotify_database(&database, !events_running());
+		else if (load_database(&database) && (EnableClustering != 1))
+			/* try reinstating the watches */
+			set_cron_watched(fd);
 #else
 		load_database(&database);
 #endif
@@ -414,14 +543,15 @@ int main(int argc, char *argv[]) {
 				Debug(DSCH, ("[%ld], normal case %d minutes to go\n",
 						(long) pid, timeDiff));
 				do {
-					if (job_runqueue())
-						sleep(10);
+					catchup_step(&database);
 					virtualTime++;
 					if (virtualTime >= timeRunning)
 						/* always run also the other timezone jobs in the last step */
 						oldGMToff = GMToff;
 					find_jobs(virtualTime, &database, TRUE, TRUE, oldGMToff);
+					replayedMinutes++;
 				} while (virtualTime < timeRunning);
+				catchup_done(FALSE);
 				break;
 
 			case medium:
@@ -443,15 +573,16 @@ int main(int argc, char *argv[]) {
 
 				/* run fixed-time jobs for each minute missed */
 				do {
-					if (job_runqueue())
-						sleep(10);
+					catchup_step(&database);
 					virtualTime++;
 					if (virtualTime >= timeRunning) 
 						/* always run also the other timezone jobs in the last step */
 						oldGMToff = GMToff;
 					find_jobs(virtualTime, &database, FALSE, TRUE, oldGMToff);
+					replayedMinutes++;
 					set_time(FALSE);
 				} while (virtualTime < timeRunning && clockTime == timeRunning);
+				catchup_done(TRUE);
 				break;
 
 			case negative:
@@ -480,8 +611,12 @@ int main(int argc, char *argv[]) {
 		}
 
 		/* Jobs to be run (if any) are loaded; clear the queue. */
+		run_seconds((int) ((StartTime + GMToff) % SECONDS_PER_MINUTE));
 		job_runqueue();
 
+		/* have the users of the next minute's jobs looked up */
+		sched_visit(timeRunning + 1, prefetch_user);
+
 		handle_signals(&database);
 	}
 
@@ -528,12 +663,12 @@ static void run_reboot_jobs(cron_db * db) {
 	(void) job_runqueue();
 }
 
-static void find_jobs(int vtime, cron_db * db, int doWild, int doNonWild, long vGMToff) {
-	char *orig_tz, *job_tz;
+static void find_job(entry *e, user *u, int vtime, int doWild, int doNonWild,
+	long vGMToff) {
 	struct tm *tm;
 	int minute, hour, dom, month, dow;
-	user *u;
-	entry *e;
+	time_t virtualSecond = (time_t)(vtime - e->delay) * (time_t)SECONDS_PER_MINUTE;
+	time_t virtualGMTSecond = virtualSecond - vGMToff;
 
 	/* The support for the job-specific timezones is not perfect. There will
 	 * be jobs missed or run twice during the DST change in the job timezone.
@@ -542,25 +677,15 @@ static void find_jobs(int vtime, cron_db * db, int doWild, int doNonWild, long v
 	 *
 	 * Make 0-based values out of tm values so we can use them as indices
 	 */
-#define maketime(tz1, tz2) do { \
-	char *t = tz1; \
-	if (t != NULL && *t != '\0') { \
-		setenv("TZ", t, 1); \
-		tm = localtime(&virtualGMTSecond); \
-	} else { if ((tz2) != NULL) \
-			setenv("TZ", (tz2), 1); \
-		else \
-			unsetenv("TZ"); \
-		tm = gmtime(&virtualSecond); \
-	} \
-	minute = tm->tm_min -FIRST_MINUTE; \
-	hour = tm->tm_hour -FIRST_HOUR; \
-	dom = tm->tm_mday -FIRST_DOM; \
-	month = tm->tm_mon +1 /* 0..11 -> 1..12 */ -FIRST_MONTH; \
-	dow = tm->tm_wday -FIRST_DOW; \
-	} while (0)
-
-	orig_tz = getenv("TZ");
+	if (e->tz != NULL && e->tz->name[0] != '\0')
+		tm = zone_time(e->tz, virtualGMTSecond);
+	else
+		tm = gmtime(&virtualSecond);
+	minute = tm->tm_min -FIRST_MINUTE;
+	hour = tm->tm_hour -FIRST_HOUR;
+	dom = tm->tm_mday -FIRST_DOM;
+	month = tm->tm_mon +1 /* 0..11 -> 1..12 */ -FIRST_MONTH;
+	dow = tm->tm_wday -FIRST_DOW;
 
 	/* the dom/dow situation is odd.  '* * 1,15 * Sun' will run on the
 	 * first and fifteenth AND every Sunday;  '* * * * Sun' will run *only*
@@ -568,33 +693,69 @@ static void find_jobs(int vtime, cron_db * db, int doWild, int doNonWild, long v
 	 * is why we keep 'e->dow_star' and 'e->dom_star'.  yes, it's bizarre.
 	 * like many bizarre things, it's the standard.
 	 */
-	for (u = db->head; u != NULL; u = u->next) {
-		for (e = u->crontab; e != NULL; e = e->next) {
-			time_t virtualSecond = (time_t)(vtime - e->delay) * (time_t)SECONDS_PER_MINUTE;
-			time_t virtualGMTSecond = virtualSecond - vGMToff;
-			job_tz = env_get("CRON_TZ", e->envp);
-			maketime(job_tz, orig_tz);
-
-			/* here we test whether time is NOW */
-			if (bit_test(e->minute, minute) &&
-				bit_test(e->hour, hour) &&
-				bit_test(e->month, month) &&
-				(((e->flags & DOM_STAR) || (e->flags & DOW_STAR))
-					? (bit_test(e->dow, dow) && bit_test(e->dom, dom))
-						: (bit_test(e->dow, dow) || bit_test(e->dom, dom))
-				)
-			) {
-				if (job_tz != NULL && vGMToff != GMToff)
-					/* do not try to run the jobs from different timezones
-					 * during the DST switch of the default timezone.
-					 */
-					continue;
-
-				if ((doNonWild &&
-						!(e->flags & (MIN_STAR | HR_STAR))) ||
-					(doWild && (e->flags & (MIN_STAR | HR_STAR))))
-					job_add(e, u);	/*will add job, if it isn't in queue already for NOW. */
-			}
+
+	/* here we test whether time is NOW */
+	if (bit_test(e->minute, minute) &&
+		bit_test(e->hour, hour) &&
+		bit_test(e->month, month) &&
+		(((e->flags & DOM_STAR) || (e->flags & DOW_STAR))
+			? (bit_test(e->dow, dow) && bit_test(e->dom, dom))
+				: (bit_test(e->dow, dow) || bit_test(e->dom, dom))
+		)
+	) {
+		if (e->tz != NULL && vGMToff != GMToff)
+			/* do not try to run the jobs from different timezones
+			 * during the DST switch of the default timezone.
+			 */
+			return;
+
+		if ((doNonWild &&
+				!(e->flags & (MIN_STAR | HR_STAR))) ||
+			(doWild && (e->flags & (MIN_STAR | HR_STAR)))) {
+			/* a field of seconds is served by the main loop in the
+			 * current minute; a minute caught up with late runs the
+			 * job just once
+			 */
+			if ((e->flags & SEC_FIELD) && vtime == timeRunning &&
+				sched_seconds_add(e, u))
+				return;
+			job_add(e, u);	/*will add job, if it isn't in queue already for NOW. */
+		}
+	}
+}
+
+static void prefetch_user(entry *e, user *u ATTRIBUTE_UNUSED) {
+	pwcache_prefetch(e->pwd->pw_name);
+}
+
+static void find_jobs(int vtime, cron_db * db, int doWild, int doNonWild, long vGMToff) {
+	char *orig_tz;
+	user *u;
+	entry *e;
+	int fromHeap;
+
+	/* In the usual case of a new minute in which both the wildcard and
+	 * fixed-time jobs run, only the entries which the run heap says are
+	 * due and the CRON_TZ entries matched by the schedule table need a
+	 * look.  Minutes revisited after a time change look up the entries
+	 * of their (hour, minute) in the schedule index, and only if that
+	 * is not available we test every entry.  Either way the entries
+	 * are tested in the order of the database, so jobs due in the same
+	 * minute are started in the order of their crontabs.
+	 */
+	fromHeap = sched_claim(vtime) && doWild && doNonWild;
+
+	orig_tz = getenv("TZ");
+
+	if (fromHeap ? sched_due(vtime, vGMToff) :
+		sched_scan(vtime, vGMToff, doNonWild)) {
+		while (sched_scan_next(&e, &u))
+			find_job(e, u, vtime, doWild, doNonWild, vGMToff);
+	}
+	else {
+		for (u = db->head; u != NULL; u = u->next) {
+			for (e = u->crontab; e != NULL; e = e->next)
+				find_job(e, u, vtime, doWild, doNonWild, vGMToff);
 		}
 	}
 	if (orig_tz != NULL)
@@ -609,10 +770,15 @@ static void find_jobs(int vtime, cron_db * db, int doWild, int doNonWild, long v
  * Note that clockTime is a unix wallclock time converted to minutes.
  */
 static void set_time(int initialize) {
+	struct timespec now;
 	struct tm tm;
 	static int isdst;
 
-	StartTime = time(NULL);
+	/* not time(), which may lag behind the timer that woke us up */
+	if (clock_gettime(CLOCK_REALTIME, &now) == 0)
+		StartTime = now.tv_sec;
+	else
+		StartTime = time(NULL);
 
 	/* We adjust the time to GMT so we can catch DST changes. */
 	tm = *localtime(&StartTime);
@@ -624,6 +790,417 @@ static void set_time(int initialize) {
 	clockTime = (int)((StartTime + GMToff) / (time_t) SECONDS_PER_MINUTE);
 }
 
+#if defined WITH_INOTIFY
+/*
+ * Return TRUE if the event loop reads inotify as the changes come.
+ */
+static int events_running(void) {
+# if defined WITH_EVENTS
+	return (efd >= 0 && events_ifd >= 0);
+# else
+	return (FALSE);
+# endif
+}
+#endif
+
+/*
+ * Return the virtual minute to wake up at.  That is the next one, unless
+ * running tickless: then it is the first minute in which an entry may
+ * run, as inotify is there to wake us up when the database changes.
+ */
+static int next_wakeup(cron_db * db) {
+	int next = timeRunning + 1;
+#if defined WITH_INOTIFY
+	int pending;
+
+	/* catching up, or a change not read or applied yet */
+	if (!Tickless || !inotify_enabled || virtualTime != timeRunning ||
+		ioctl(db->ifd, FIONREAD, &pending) < 0 || pending > 0 ||
+		inotify_reload_time() != 0)
+		return (next);
+
+	next = sched_next(timeRunning + 1);
+	if (next - timeRunning > MAX_IDLE_MINUTES)
+		next = timeRunning + MAX_IDLE_MINUTES;
+#else
+	(void) db;
+#endif
+	return (next);
+}
+
+/*
+ * Return the time at which the virtual minute vtime begins.  If DST
+ * starts before then, that is earlier than GMToff has it, by the change
+ * of the offset; a DST end is left to the time change cases.
+ */
+static time_t minute_start(int vtime) {
+	time_t when, local;
+	struct tm tm;
+
+	when = (time_t) vtime * SECONDS_PER_MINUTE - GMToff;
+	local = (time_t) vtime * SECONDS_PER_MINUTE;
+	gmtime_r(&local, &tm);
+	tm.tm_isdst = -1;
+	if ((local = mktime(&tm)) != (time_t) -1 && local < when &&
+		local > time(NULL))
+		when = local;
+	return (when);
+}
+
+static void wait_until(int target, cron_db * db) {
+#if defined WITH_EVENTS
+	if (efd >= 0 && event_wait(minute_start(target), db))
+		return;
+#endif
+	if (target > timeRunning + 1)
+		idle_sleep(target, db);
+	else
+		cron_sleep(target, db);
+}
+
+/*
+ * Wait for the given second of the current minute.
+ */
+static void wait_second(int second, cron_db * db) {
+	time_t when, now;
+
+	when = (time_t) timeRunning * SECONDS_PER_MINUTE - GMToff + second;
+#if defined WITH_EVENTS
+	if (efd >= 0 && event_wait(when, db))
+		return;
+#endif
+	if ((now = time(NULL)) < when) {
+		sleep((unsigned int) (when - now));
+		handle_signals(db);
+	}
+}
+
+/*
+ * Queue the jobs with a field of seconds due up to the given second of
+ * the current minute.  Return how many there are.
+ */
+static int run_seconds(int second) {
+	entry *e;
+	user *u;
+	int n = 0;
+
+	while (sched_seconds_due(second, &e, &u)) {
+		job_add(e, u);
+		n++;
+	}
+	return (n);
+}
+
+static time_t monotonic(void) {
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		return (time(NULL));
+	return (ts.tv_sec);
+}
+
+/*
+ * Wait for the given number of seconds, serving signals and events.
+ */
+static void pause_for(int seconds, cron_db * db) {
+	time_t end = monotonic() + seconds, left;
+
+	while (!got_sigintterm && (left = end - monotonic()) > 0) {
+#if defined WITH_EVENTS
+		if (efd >= 0 && event_wait(time(NULL) + left, db))
+			continue;
+#endif
+		sleep((unsigned int) left);
+		handle_signals(db);
+	}
+}
+
+/*
+ * Start the jobs queued for a minute being caught up with.  If there were
+ * any, pause before the next one, unless catching up has taken longer
+ * than CatchupLimit already; then the rest is run without pauses.
+ */
+static void catchup_step(cron_db * db) {
+	int run;
+
+	if (catchupStart == 0)
+		catchupStart = monotonic();
+
+	run = job_runqueue();
+	replayedJobs += run;
+	if (run > 0 && CatchupSpacing > 0 &&
+		monotonic() - catchupStart < CatchupLimit)
+		pause_for(CatchupSpacing, db);
+}
+
+/*
+ * Finish catching up.  A few minutes late without jobs to run is common
+ * on a busy host and is not worth logging; a time change is.
+ */
+static void catchup_done(int timeChanged) {
+	char buf[128];
+
+	replayedJobs += job_runqueue();
+	snprintf(buf, sizeof buf, "Caught up with %d minutes, %d jobs started",
+		replayedMinutes, replayedJobs);
+	if (timeChanged || replayedJobs > 0)
+		log_it("CRON", getpid(), "INFO", buf, 0);
+	else
+		Debug(DSCH, ("[%ld] %s\n", (long) getpid(), buf));
+	replayedMinutes = replayedJobs = 0;
+	catchupStart = 0;
+}
+
+#if defined WITH_EVENTS
+static int watch_fd(int fd) {
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return (epoll_ctl(efd, EPOLL_CTL_ADD, fd, &ev));
+}
+
+/*
+ * Set up the event loop: the signals come in through a signalfd, the
+ * time through a timerfd, the children that exit through their pidfds,
+ * and inotify, if enabled, is watched as well.  Return FALSE if that
+ * fails; we sleep and poll then as before.
+ */
+static int events_init(int ifd) {
+	sigemptyset(&event_signals);
+	sigaddset(&event_signals, SIGCHLD);
+	sigaddset(&event_signals, SIGHUP);
+	sigaddset(&event_signals, SIGINT);
+	sigaddset(&event_signals, SIGTERM);
+	sigaddset(&event_signals, SIGURG);
+	sigaddset(&event_signals, SIGIO);
+	if (sigprocmask(SIG_BLOCK, &event_signals, &old_sigmask) < 0)
+		return (FALSE);
+
+	if ((efd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+		(sfd = signalfd(-1, &event_signals, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+		(tfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)) < 0 ||
+		watch_fd(sfd) < 0 || watch_fd(tfd) < 0 ||
+		(ifd >= 0 && inotify_enabled && watch_fd(ifd) < 0)) {
+		int saved_errno = errno;
+
+		if (efd >= 0)
+			close(efd);
+		if (sfd >= 0)
+			close(sfd);
+		if (tfd >= 0)
+			close(tfd);
+		efd = sfd = tfd = -1;
+		sigprocmask(SIG_SETMASK, &old_sigmask, NULL);
+		errno = saved_errno;
+		return (FALSE);
+	}
+	if (ifd >= 0 && inotify_enabled)
+		events_ifd = ifd;
+	return (TRUE);
+}
+
+static void read_signals(cron_db * db) {
+	struct signalfd_siginfo si;
+
+	while (read(sfd, &si, sizeof si) == (ssize_t) sizeof si) {
+		switch (si.ssi_signo) {
+		case SIGCHLD:
+			/* the others are reaped through their pidfds */
+			if (reap_all)
+				got_sigchld = 1;
+			break;
+		case SIGHUP:
+			got_sighup = 1;
+			break;
+		case SIGINT:
+		case SIGTERM:
+			got_sigintterm = 1;
+			break;
+		case SIGURG:
+			got_sigurg = 1;
+			break;
+		}
+	}
+	handle_signals(db);
+}
+
+static void reap_child(int pfd) {
+#if defined HAVE_PIDFD_OPEN
+	siginfo_t si;
+
+	memset(&si, 0, sizeof si);
+	if (waitid(P_PIDFD, (id_t) pfd, &si, WEXITED | WNOHANG) == 0) {
+		if (si.si_pid != 0)
+			Debug(DPROC, ("[%ld] pidfd...pid #%ld died, stat=%d\n",
+					(long) getpid(), (long) si.si_pid, si.si_status));
+	}
+	else if (errno == EINVAL) {
+		/* pidfd_open() came with Linux 5.3, P_PIDFD only with 5.4;
+		 * from now on all children are reaped on SIGCHLD
+		 */
+		no_pidfd_wait = TRUE;
+		reap_all = TRUE;
+		sigchld_reaper();
+	}
+#endif
+	/* closing it also removes it from the epoll set */
+	close(pfd);
+}
+
+/*
+ * Wait until the time when, serving the signals and the
+ * children that exit meanwhile.  Changes of the database are read
+ * as soon as inotify reports them and loaded once they settle; we
+ * return then, and after signals,
+ * so that the caller can reconsider the target.  We return also when
+ * the clock is set, so that the time change is handled at once.
+ * Return FALSE if the event loop fails.
+ */
+static int event_wait(time_t when, cron_db * db) {
+	struct itimerspec its;
+	struct epoll_event ev[16];
+	int i, n, timeout, wait, done = FALSE;
+#if defined WITH_INOTIFY
+	time_t reload;
+#endif
+
+	memset(&its, 0, sizeof its);
+	its.it_value.tv_sec = when;
+	/* wake up as well when the clock is set, to catch up right away */
+	if (timerfd_settime(tfd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+			&its, NULL) < 0 &&
+		timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		return (FALSE);
+
+	/* as cron_sleep(), do not oversleep if the clock is set back and
+	 * the kernel cannot tell us
+	 */
+	timeout = (int) (when - time(NULL) + 1);
+	if (timeout < 1)
+		timeout = 1;
+	Debug(DSCH, ("[%ld] Target time=%ld, sec-to-wait=%d\n",
+			(long) getpid(), (long) when, timeout - 1));
+
+	while (!done && !got_sigintterm) {
+		wait = timeout * 1000;
+#if defined WITH_INOTIFY
+		/* wake up to load the changes read so far */
+		if (inotify_enabled && (reload = inotify_reload_time()) != 0) {
+			reload -= time(NULL);
+			if (reload < 0)
+				reload = 0;
+			if (reload < timeout)
+				wait = (int) reload * 1000;
+		}
+#endif
+		n = epoll_wait(efd, ev, sizeof ev / sizeof ev[0], wait);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			log_it("CRON", getpid(), "ERROR", "epoll_wait failed", errno);
+			return (FALSE);
+		}
+		if (n == 0) {
+#if defined WITH_INOTIFY
+			if (wait < timeout * 1000) {
+				check_inotify_database(db, FALSE);
+				done = TRUE;
+				continue;
+			}
+#endif
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			int fd = ev[i].data.fd;
+
+			if (fd == tfd) {
+				uint64_t expirations;
+
+				if (read(tfd, &expirations, sizeof expirations) < 0 &&
+					errno == ECANCELED)
+					Debug(DSCH, ("[%ld] clock was set\n", (long) getpid()));
+				done = TRUE;
+			}
+			else if (fd == sfd) {
+				read_signals(db);
+				done = TRUE;
+			}
+			else if (fd == events_ifd) {
+#if defined WITH_INOTIFY
+				if (inotify_enabled)
+					check_inotify_database(db, FALSE);
+				else {
+					char buf[4096];
+
+					/* a full reload is pending */
+					(void) read(fd, buf, sizeof buf);
+				}
+#endif
+				done = TRUE;
+			}
+			else
+				reap_child(fd);
+		}
+	}
+	return (TRUE);
+}
+#endif
+
+/*
+ * Watch for the exit of a child of ours.  Without a pidfd for it, all
+ * children are reaped on SIGCHLD, as before.
+ */
+void watch_child(pid_t child) {
+#if defined WITH_EVENTS && defined HAVE_PIDFD_OPEN
+	int pfd;
+
+	if (efd >= 0 && !no_pidfd_wait && (pfd = pidfd_open(child, 0)) >= 0) {
+		if (watch_fd(pfd) == 0)
+			return;
+		close(pfd);
+	}
+#else
+	(void) child;
+#endif
+#if defined WITH_EVENTS
+	reap_all = TRUE;
+#endif
+}
+
+/*
+ * In a child of ours, let the signals the event loop takes through its
+ * signalfd be delivered again.
+ */
+void unblock_signals(void) {
+#if defined WITH_EVENTS
+	if (efd >= 0)
+		sigprocmask(SIG_SETMASK, &old_sigmask, NULL);
+#endif
+}
+
+/*
+ * Sleep until the virtual minute target, or until a signal or a change
+ * of the database wakes us up.
+ */
+static void idle_sleep(int target, cron_db * db) {
+	struct timespec ts;
+	int err;
+
+	ts.tv_sec = minute_start(target);
+	ts.tv_nsec = 0;
+	Debug(DSCH, ("[%ld] Idle until %ld, %d minutes\n",
+			(long) getpid(), (long) ts.tv_sec, target - timeRunning));
+
+	err = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, NULL);
+	if (err == EINTR)
+		handle_signals(db);
+	else if (err != 0)
+		cron_sleep(timeRunning + 1, db);
+}
+
 /*
  * Try to just hit the next minute.
  */
@@ -675,6 +1252,10 @@ static void sigurg_handler(int x ATTRIBUTE_UNUSED) {
 	got_sigurg = 1;
 }
 
+static void sigio_handler(int x ATTRIBUTE_UNUSED) {
+	/* nothing to do, inotify is read in the main loop */
+}
+
 static void sigchld_reaper(void) {
 	WAIT_T waiter;
 	PID_T pid;
@@ -699,10 +1280,22 @@ static void sigchld_reaper(void) {
 	} while (pid > 0);
 }
 
+static int parse_seconds(const char *arg, int *seconds) {
+	char *end;
+	long val;
+
+	errno = 0;
+	val = strtol(arg, &end, 10);
+	if (errno != 0 || end == arg || *end != '\0' || val < 0 || val > INT_MAX)
+		return (FALSE);
+	*seconds = (int) val;
+	return (TRUE);
+}
+
 static void parse_args(int argc, char *argv[]) {
 	int argch;
 
-	while (-1 != (argch = getopt(argc, argv, "hnfpsiPx:m:cV"))) {
+	while (-1 != (argch = getopt(argc, argv, "hnfpq:r:sitPx:m:cVw:W:"))) {
 		switch (argch) {
 			case 'x':
 				if (!set_debug_flags(optarg))
@@ -715,12 +1308,31 @@ static void parse_args(int argc, char *argv[]) {
 			case 'p':
 				PermitAnyCrontab = 1;
 				break;
+			case 'q':
+				if (!parse_seconds(optarg, &ReloadDelay))
+					usage();
+				break;
+			case 'r':
+				if (!parse_seconds(optarg, &FullScanInterval))
+					usage();
+				break;
 			case 's':
 				SyslogOutput = 1;
 				break;
 			case 'i':
 				DisableInotify = 1;
 				break;
+			case 't':
+				Tickless = 1;
+				break;
+			case 'w':
+				if (!parse_seconds(optarg, &CatchupSpacing))
+					usage();
+				break;
+			case 'W':
+				if (!parse_seconds(optarg, &CatchupLimit))
+					usage();
+				break;
 			case 'P':
 				ChangePath = 0;
 				break;
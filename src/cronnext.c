@@ -40,36 +40,6 @@
 #define SYSTEM   0x04			// include system crontab
 #define ALLJOBS  0x08			// print all jobs in interval
 
-#ifdef WITH_INOTIFY
-void set_cron_watched(int fd) {
-/* empty stub */
-	(void)fd;
-}
-#endif
-
-void do_command(entry *e, user *u) {
-/* empty stub */
-	(void)e;
-	(void)u;
-}
-
-#ifdef WITH_SELINUX
-int get_security_context(const char *name, int crontab_fd,
-			 security_context_t *rcontext, const char *tabname) {
-/* empty stub */
-	(void)name;
-	(void)crontab_fd;
-	(void)tabname;
-	*rcontext = NULL;
-	return 0;
-}
-
-void free_security_context(security_context_t *scontext) {
-/* empty stub */
-	(void)scontext;
-}
-#endif
-
 /*
  * print entry flags
  */
@@ -79,7 +49,9 @@ const char *flagname[]= {
 	"DOM_STAR",
 	"DOW_STAR",
 	"WHEN_REBOOT",
-	"DONT_LOG"
+	"DONT_LOG",
+	"MAIL_WHEN_ERR",
+	"SEC_FIELD"
 };
 
 void printflags(char *indent, int flags) {
@@ -148,10 +120,24 @@ int matchday(entry *e, time_t time) {
 		bit_test(e->dow, current.tm_wday);
 }
 
+/*
+ * first second from time on, in the minute of time, in which an entry with a
+ * field of seconds runs; -1 if none
+ */
+time_t nextsecond(entry *e, time_t time) {
+	int second;
+
+	for (second = (int)(time % 60); second < 60; second++)
+		if (bit_test(e->second, second))
+			return time - time % 60 + second;
+	return -1;
+}
+
 /*
  * next time matching a crontab entry
  */
 time_t nextmatch(entry *e, time_t start, time_t end) {
+	time_t next;
 	time_t time;
 	struct tm current;
 
@@ -168,6 +154,7 @@ time_t nextmatch(entry *e, time_t start, time_t end) {
 			current.tm_mday = 1;
 			current.tm_hour = 0;
 			current.tm_min = 0;
+			current.tm_sec = 0;
 			time = mktime(&current);
 			continue;
 		}
@@ -186,11 +173,15 @@ time_t nextmatch(entry *e, time_t start, time_t end) {
 			matchday(e, time) &&
 			bit_test(e->hour, current.tm_hour) &&
 			bit_test(e->minute, current.tm_min)
-		)
-			return time;
+		) {
+			if (!(e->flags & SEC_FIELD))
+				return time;
+			if ((next = nextsecond(e, time)) >= 0)
+				return next;
+		}
 
 		/* skip to next minute */
-		time += 60;
+		time += 60 - time % 60;
 	}
 
 	return -1;
@@ -249,7 +240,8 @@ time_t cronnext(cron_db database,
 				continue;
 			for (next = nextmatch(e, start, end);
 			     next <= end;
-			     next = nextmatch(e, next + 60, end)) {
+			     next = nextmatch(e, next +
+				(e->flags & SEC_FIELD ? 1 : 60), end)) {
 				if (next < 0)
 					break;
 				if (closest < 0 || next < closest)
@@ -269,12 +261,13 @@ time_t cronnext(cron_db database,
  * load installed crontabs and/or crontab files
  */
 cron_db database(int installed, char **additional) {
-	cron_db db = {NULL, NULL, (time_t) 0};
+	cron_db db;
 	struct passwd pw;
 	int fd;
 	struct stat ss;
 	user *u;
 
+	memset(&db, 0, sizeof(db));
 	if (installed)
 		load_database(&db);
 
@@ -445,7 +445,7 @@ static void list_cmd(void) {
 	/* file is open. copy to stdout, close.
 	 */
 	Set_LineNum(1);
-	while (EOF != (ch = get_char(f))) {
+	while (EOF != (ch = getc(f))) {
 		if (colorize) {
 			if (!in_comment && new_line && ch == '#') {
 				in_comment = 1;
@@ -627,7 +627,7 @@ static int backup_crontab(const char *crontab_path) {
 		goto cleanup;
 
 	if (EOF != ch)
-		while (EOF != (ch = get_char(crontab_file)))
+		while (EOF != (ch = getc(crontab_file)))
 			putc(ch, backup_file);
 
 	printf("Backup of %s's previous crontab saved to %s\n", User, backup_path);
@@ -744,7 +744,7 @@ static void edit_cmd(void) {
 	/* copy the rest of the crontab (if any) to the temp file.
 	 */
 	if (EOF != ch)
-		while (EOF != (ch = get_char(f)))
+		while (EOF != (ch = getc(f)))
 			putc(ch, NewCrontab);
 
 #ifdef WITH_SELINUX
@@ -1005,7 +1005,7 @@ static int replace_cmd(void) {
 	 */
 	rewind(NewCrontab);
 	Set_LineNum(1);
-	while (EOF != (ch = get_char(NewCrontab)))
+	while (EOF != (ch = getc(NewCrontab)))
 		putc(ch, tmp);
 	if (ftruncate(fileno(tmp), ftell(tmp)) == -1) {
 		fprintf(stderr, "%s: error while writing new crontab to %s\n",
@@ -1092,8 +1092,9 @@ static int replace_cmd(void) {
  *  -1 syntax issue (can be fixed by user)
  *  -2 any other error, which can not be fixed by user
  */
-static int check_syntax(FILE * crontab_file) {
+static int check_syntax(FILE * file) {
 	char **envp = env_init();
+	cron_buf buf, *crontab_file = &buf;
 	int eof = FALSE;
 	int envs = 0, entries = 0;
 
@@ -1105,6 +1106,13 @@ static int check_syntax(FILE * crontab_file) {
 		return (-2);
 	}
 
+	/* nothing has been read from file through stdio yet */
+	if (read_buf(fileno(file), crontab_file) != OK) {
+		perror(Filename);
+		env_free(envp);
+		return (-2);
+	}
+
 	while (!CheckErrorCount && !eof) {
 		char envstr[MAX_ENVSTR];
 		entry *e;
@@ -1137,6 +1145,7 @@ static int check_syntax(FILE * crontab_file) {
 		}
 	}
 	env_free(envp);
+	free(buf.data);
 
 	if (envs > MAX_USER_ENVS) {
 		fprintf(stderr,
@@ -1230,14 +1239,15 @@ static int hostset_cmd(void) {
 
 static int hostget_cmd(void) {
 	char n[MAX_FNAME];
-	FILE *f;
+	cron_buf buf;
+	int fd;
 
 	if (!glue_strings(n, sizeof n, SPOOL_DIR, CRON_HOSTNAME, '/')) {
 		fprintf(stderr, "path too long\n");
 		return (-2);
 	}
 
-	if (!(f = fopen(n, "r"))) {
+	if ((fd = open(n, O_RDONLY)) == -1) {
 		if (errno == ENOENT)
 			fprintf(stderr, "File %s not found\n", n);
 		else
@@ -1245,13 +1255,16 @@ static int hostget_cmd(void) {
 		return (-2);
 	}
 
-	if (get_string(Host, sizeof Host, f, "\n") == EOF) {
+	if (read_buf(fd, &buf) != OK ||
+		get_string(Host, sizeof Host, &buf, "\n") == EOF) {
 		fprintf(stderr, "Error reading from %s\n", n);
-		fclose(f);
+		free(buf.data);
+		close(fd);
 		return (-2);
 	}
 
-	fclose(f);
+	free(buf.data);
+	close(fd);
 
 	printf("%s\n", Host);
 	fflush(stdout);
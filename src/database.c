@@ -34,6 +34,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <pwd.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -57,27 +58,37 @@
 static void overwrite_database(cron_db *, cron_db *);
 
 static void process_crontab(const char *, const char *,
-	const char *, cron_db *, cron_db *);
+	const char *, int, cron_db *, cron_db *);
 
-static int not_a_crontab(DIR_T * dp);
+static int not_a_crontab(const char *name);
 /* return 1 if we should skip this file */
 
+static unsigned hash_string(const char *s);
+
 static void max_mtime(const char *dir_name, struct stat *max_st);
 /* record max mtime of any file under dir_name in max_st */
 
+static time_t next_full_scan;	/* of every crontab, see load_database() */
+
+/*
+ * Check the crontab tabname, opened already as crontab_fd unless that
+ * is -1, and stated as *st unless that is NULL, and return its
+ * descriptor, or -1 if it is not to be loaded.
+ */
 static int
-check_open(const char *tabname, const char *uname,
-	struct passwd *pw, time_t * mtime) {
+check_open(int crontab_fd, const struct stat *st, const char *tabname,
+	const char *uname, struct passwd *pw, time_t * mtime) {
 	struct stat statbuf;
-	int crontab_fd;
 	pid_t pid = getpid();
 
-	if ((crontab_fd =
+	if (crontab_fd == -1 && (crontab_fd =
 			open(tabname, O_RDONLY | O_NONBLOCK, 0)) == -1) {
 		log_it(uname, pid, "CAN'T OPEN", tabname, errno);
 		return (-1);
 	}
-	if (fstat(crontab_fd, &statbuf) < OK) {
+	if (st != NULL)
+		statbuf = *st;
+	else if (fstat(crontab_fd, &statbuf) < OK) {
 		log_it(uname, pid, "STAT FAILED", tabname, errno);
 		close(crontab_fd);
 		return (-1);
@@ -112,6 +123,28 @@ check_open(const char *tabname, const char *uname,
 
 static orphan *orphans;
 
+/* orphans are looked up again when the local user database changes,
+ * and for users of other sources (LDAP, ...) at growing intervals
+ */
+#define ORPHAN_RECHECK_MIN	60	/* seconds */
+#define ORPHAN_RECHECK_MAX	3600
+
+static time_t orphan_check_at;
+static int orphan_interval = ORPHAN_RECHECK_MIN;
+static struct stat passwd_stat, group_stat;
+
+static int file_changed(const char *path, struct stat *old) {
+	struct stat st;
+	int changed;
+
+	if (stat(path, &st) < OK)
+		memset(&st, 0, sizeof st);
+	changed = st.st_ino != old->st_ino || st.st_mtime != old->st_mtime ||
+		st.st_size != old->st_size;
+	*old = st;
+	return (changed);
+}
+
 static void
 free_orphan(orphan *o) {
 	free(o->tabname);
@@ -124,9 +157,28 @@ void
 check_orphans(cron_db *db) {
 	orphan *prev_orphan = NULL;
 	orphan *o = orphans;
+	time_t now = time(NULL);
+	int changed;
+
+	if (o == NULL)
+		return;
+	changed = file_changed(_PATH_PASSWD, &passwd_stat);
+	changed |= file_changed(_PATH_GROUP, &group_stat);
+	if (!changed && now >= orphan_check_at - orphan_interval &&
+		now < orphan_check_at)
+		return;
 
+	if (changed)
+		orphan_interval = ORPHAN_RECHECK_MIN;
+	else if ((orphan_interval *= 2) > ORPHAN_RECHECK_MAX)
+		orphan_interval = ORPHAN_RECHECK_MAX;
+	orphan_check_at = now + orphan_interval;
+	Debug(DLOAD, ("[%ld] checking orphans, next in %d seconds\n",
+			(long) getpid(), orphan_interval));
+
+	begin_user_lookups();
 	while (o != NULL) {
-		if (getpwnam(o->uname) != NULL) {
+		if (lookup_user(o->uname) != NULL) {
 			orphan *next = o->next;
 
 			if (prev_orphan == NULL) {
@@ -135,7 +187,7 @@ check_orphans(cron_db *db) {
 				prev_orphan->next = next;
 			}
 
-			process_crontab(o->uname, o->fname, o->tabname,
+			process_crontab(o->uname, o->fname, o->tabname, -1,
 				db, NULL);
 
 			/* process_crontab could have added a new orphan */
@@ -149,6 +201,8 @@ check_orphans(cron_db *db) {
 			o = o->next;
 		}
 	}
+	end_user_lookups();
+	endpwent();
 }
 
 static int
@@ -204,44 +258,70 @@ add_orphan(const char *uname, const char *fname, const char *tabname) {
 
 	o->next = orphans;
 	orphans = o;
+
+	/* look for the new orphan's user soon */
+	orphan_interval = ORPHAN_RECHECK_MIN;
+	orphan_check_at = time(NULL) + orphan_interval;
 	return;
 
 cleanup:
 	free_orphan(o);
 }
 
-static void
-process_crontab(const char *uname, const char *fname, const char *tabname,
-	cron_db * new_db, cron_db * old_db) {
+/*
+ * Check the crontab tabname.  Return the descriptor to load it from, and
+ * set *pwp to its owner and *mtimep to the time to record, or return -1
+ * if there is nothing to load.  *reusep is then the user of old_db to
+ * keep, taken out of old_db, if the crontab has not changed.  If it has
+ * a newer mtime, its user is taken out of old_db into *oldp instead, to
+ * be dropped by replace_crontab() unless the contents are the same.
+ * crontab_fd and st are as for check_open().
+ */
+static int
+check_crontab(const char *uname, const char *fname, const char *tabname,
+	int crontab_fd, const struct stat *st, cron_db * new_db, cron_db * old_db, user ** reusep,
+	user ** oldp, struct passwd **pwp, time_t * mtimep) {
 	struct passwd *pw = NULL;
-	int crontab_fd = -1;
 	user *u = NULL;
 	time_t mtime;
-	int crond_crontab = (fname == NULL) && (strcmp(tabname, SYSCRONTAB) != 0);
 
+	*reusep = *oldp = NULL;
 	if (fname == NULL) {
 		/* must be set to something for logging purposes.
 		 */
 		fname = "*system*";
 	}
-	else if ((pw = getpwnam(uname)) == NULL) {
+	else if ((pw = lookup_user(uname)) == NULL) {
+		/* the user could not be looked up, which is not to say
+		 * it is gone: keep what was loaded for it, if anything
+		 */
+		if (errno != 0 && old_db != NULL &&
+			(u = find_user(old_db, fname, NULL)) != NULL) {
+			Debug(DLOAD, ("\t%s: [lookup failed, using old data]\n",
+					fname));
+			unlink_user(old_db, u);
+			*reusep = u;
+			goto next_crontab;
+		}
+
 		/* file doesn't have a user in passwd file.
 		 */
-		log_it(uname, getpid(), "ORPHAN", "no passwd entry", 0);
+		if (errno == 0)
+			log_it(uname, getpid(), "ORPHAN", "no passwd entry", 0);
 		add_orphan(uname, fname, tabname);
 
 		goto next_crontab;
 	}
 
-	if ((crontab_fd = check_open(tabname, uname, pw, &mtime)) == -1)
+	if ((crontab_fd = check_open(crontab_fd, st, tabname, uname, pw, &mtime)) == -1)
 		goto next_crontab;
 
 	mtime = TMIN(new_db->mtime, mtime);
 
 	Debug(DLOAD, ("\t%s:", fname));
 
-	if (old_db != NULL)
-		u = find_user(old_db, fname, crond_crontab ? tabname : NULL);	/* find user in old_db */
+	if (old_db != NULL)	/* find user in old_db */
+		u = find_user(old_db, fname, pw == NULL ? tabname : NULL);
 
 	if (u != NULL) {
 		/* if crontab has not changed since we last read it
@@ -250,43 +330,368 @@ process_crontab(const char *uname, const char *fname, const char *tabname,
 		if (u->mtime == mtime) {
 			Debug(DLOAD, (" [no change, using old data]"));
 			unlink_user(old_db, u);
-			link_user(new_db, u);
+			*reusep = u;
 			goto next_crontab;
 		}
 
-		/* before we fall through to the code that will reload
-		 * the user, let's deallocate and unlink the user in
-		 * the old database.  This is more a point of memory
-		 * efficiency than anything else, since all leftover
-		 * users will be deleted from the old database when
-		 * we finish with the crontab...
+		/* the file may have been rewritten with the same
+		 * contents, f.e. by configuration management.  That is
+		 * only known once it is read, so the user is kept aside.
 		 */
-		Debug(DLOAD, (" [delete old data]"));
+		Debug(DLOAD, (" [changed]\n"));
 		unlink_user(old_db, u);
-		free_user(u);
-		log_it(fname, getpid(), "RELOAD", tabname, 0);
+		*oldp = u;
 	}
 
-	u = load_user(crontab_fd, pw, uname, fname, tabname);	/* read the file */
-	crontab_fd = -1; /* load_user takes care of closing the file */
-	if (u != NULL) {
-		u->mtime = mtime;
-		link_user(new_db, u);
-	}
+	*pwp = pw;
+	*mtimep = mtime;
+	return (crontab_fd);
 
   next_crontab:
 	if (crontab_fd != -1) {
 		Debug(DLOAD, (" [done]\n"));
 		close(crontab_fd);
 	}
+	return (-1);
+}
+
+/* link u, just loaded, into new_db and schedule its jobs */
+static void
+add_crontab(cron_db * new_db, user * u, time_t mtime) {
+	entry *e;
+	int n = 0;
+
+	u->mtime = mtime;
+	link_user(new_db, u);
+	for (e = u->crontab; e != NULL; e = e->next) {
+		e->order = n++;
+		sched_add(e, u);
+	}
+}
+
+typedef struct _entry_slot {
+	entry	*e;
+	int	kept;
+} entry_slot;
+
+/*
+ * Bring old, whose entries are in the run heap, up to date with u, just
+ * loaded from its changed crontab.  The entries of old which are also in
+ * u are kept as they are, in the order of u; the others are removed, and
+ * those only in u added.  u is freed.  Return FALSE, doing nothing, if
+ * out of memory.
+ */
+static int update_crontab(user * old, user * u) {
+	entry *e, *ne, *list = NULL, **tail = &list;
+	entry_slot *slots;
+	unsigned size = 16, mask, i;
+	int n = 0, kept = 0, added = 0;
+	security_context_t scontext;
+	cache_rec *cached;
+
+	/* the entries of old, hashed by command */
+	for (e = old->crontab; e != NULL; e = e->next)
+		n++;
+	while (size < (unsigned) n * 2)
+		size *= 2;
+	if ((slots = calloc(size, sizeof (*slots))) == NULL)
+		return (FALSE);
+	mask = size - 1;
+	for (e = old->crontab; e != NULL; e = e->next) {
+		for (i = hash_string(e->cmd) & mask; slots[i].e != NULL;
+			i = (i + 1) & mask) ;
+		slots[i].e = e;
+	}
+
+	for (e = u->crontab; e != NULL; e = ne) {
+		ne = e->next;
+		for (i = hash_string(e->cmd) & mask; slots[i].e != NULL;
+			i = (i + 1) & mask)
+			if (!slots[i].kept && same_entry(slots[i].e, e))
+				break;
+		if (slots[i].e != NULL) {
+			slots[i].kept = TRUE;
+			free_entry(e);
+			e = slots[i].e;
+			kept++;
+		}
+		else
+			added++;
+		e->order = kept + added - 1;
+		e->next = NULL;
+		*tail = e;
+		tail = &e->next;
+	}
+	u->crontab = NULL;
+	for (i = 0; i < size; i++)
+		if (slots[i].e != NULL && !slots[i].kept) {
+			sched_remove(slots[i].e);
+			free_entry(slots[i].e);
+		}
+	free(slots);
+
+	old->crontab = list;
+	for (e = list; e != NULL; e = e->next)
+		sched_add(e, old);
+	old->hash = u->hash;
+	scontext = old->scontext;
+	old->scontext = u->scontext;
+	u->scontext = scontext;
+	cached = old->cached;
+	old->cached = u->cached;
+	u->cached = cached;
+	free_user(u);
+	Debug(DLOAD, ("\t%s: [%d kept, %d added, %d removed]\n", old->name,
+			kept, added, n - kept));
+	return (TRUE);
+}
+
+/* link the crontab tabname into new_db, in place of old, its user with
+ * an older mtime if any.  If its contents are the same (u is NULL and
+ * same is set), old is kept as it is, its cache record keyed anew by
+ * cache_rekey(); otherwise it is updated from u,
+ * just loaded, or dropped if u is NULL.
+ */
+static void
+replace_crontab(cron_db * new_db, user * old, user * u, int same,
+	time_t mtime, const char *tabname) {
+	if (old != NULL && same) {
+		Debug(DLOAD, ("\t%s: [same contents, using old data]\n",
+				old->name));
+		old->mtime = mtime;
+		link_user(new_db, old);
+		return;
+	}
+	if (old != NULL) {
+		log_it(old->name, getpid(), "RELOAD", tabname, 0);
+		if (u != NULL && update_crontab(old, u)) {
+			old->mtime = mtime;
+			link_user(new_db, old);
+			return;
+		}
+		Debug(DLOAD, ("\t%s: [delete old data]\n", old->name));
+		free_user(old);
+	}
+	if (u != NULL)
+		add_crontab(new_db, u, mtime);
+}
+
+static void
+process_crontab(const char *uname, const char *fname, const char *tabname,
+	int crontab_fd, cron_db * new_db, cron_db * old_db) {
+	struct passwd *pw;
+	user *u, *old;
+	time_t mtime;
+	int same = FALSE;
+
+	crontab_fd = check_crontab(uname, fname, tabname, crontab_fd, NULL,
+		new_db, old_db, &u, &old, &pw, &mtime);
+	if (crontab_fd == -1) {
+		if (u != NULL)
+			link_user(new_db, u);
+		return;
+	}
+
+	/* load_user takes care of closing the file */
+	if (old != NULL && (same = same_crontab(crontab_fd, old))) {
+		cache_rekey(old, crontab_fd);
+		close(crontab_fd);
+	}
+	else
+		u = load_user(crontab_fd, pw, uname,
+			fname != NULL ? fname : "*system*", tabname);
+	replace_crontab(new_db, old, u, same, mtime, tabname);
+}
+
+/*
+ * Load the crontabs in the directory dir_name, which are those of
+ * users if spool is set, and system crontabs otherwise.  The files are
+ * opened, stated and read a batch at a time, see uring_open(), so the
+ * disk works on the whole batch rather than on each file in turn.  What
+ * the cache has is not read.
+ *
+ * The crontabs of a batch are checked here, as that looks up users and
+ * logs, then parsed on up to one thread per processor, and linked into
+ * new_db in the order they were read.
+ */
+#define LOAD_BATCH		128
+#define LOAD_PER_THREAD		4	/* crontabs worth a thread */
+#define LOAD_THREADS_MAX	(LOAD_BATCH / LOAD_PER_THREAD)
+
+typedef struct _load_job {
+	char		name[NAME_MAX + 1];
+	char		tabname[NAME_MAX + 1];
+	const char	*uname, *fname;
+	uring_file	f;		/* fd is -1 if there is nothing to parse */
+	struct passwd	*pw;		/* copy of the owner, or NULL */
+	time_t		mtime;
+	user		*u;		/* parsed, or kept from old_db */
+	user		*old;		/* user of old_db with an older mtime */
+	int		same;		/* contents same as those of old */
+} load_job;
+
+static void parse_job(load_job * j) {
+	uring_file *f = &j->f;
+
+	if (f->fd == -1)
+		return;
+	if (j->old != NULL && (j->same = f->buf.data != NULL ?
+			hash_buf(&f->buf) == j->old->hash :
+			same_crontab(f->fd, j->old))) {
+		cache_rekey(j->old, f->fd);
+		free(f->buf.data);
+		close(f->fd);
+	}
+	else
+		j->u = load_user_read(f->fd, f->stat ? &f->st : NULL, &f->buf,
+			j->pw, j->uname, j->fname, j->tabname);
+}
+#ifdef HAVE_PTHREAD
+static load_job *parse_jobs;
+static int parse_next, parse_count;
+DEFINE_LOCK(parse_lock);
+
+static void *parse_worker(void *arg) {
+	int i;
+
+	(void) arg;
+	for (;;) {
+		LOCK(&parse_lock);
+		i = parse_next < parse_count ? parse_next++ : -1;
+		UNLOCK(&parse_lock);
+		if (i < 0) {
+			free_user_lookup();
+			return (NULL);
+		}
+		parse_job(&parse_jobs[i]);
+	}
+}
+#endif
+
+static void parse_batch(load_job * jobs, int n) {
+	int i;
+#ifdef HAVE_PTHREAD
+	static long ncpu;
+	pthread_t threads[LOAD_THREADS_MAX];
+	sigset_t all, mask;
+	int nthreads;
+
+	if (ncpu == 0 && (ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		ncpu = 1;
+	nthreads = n / LOAD_PER_THREAD;
+	if (nthreads > ncpu)
+		nthreads = (int) ncpu;
+
+	if (nthreads > 1) {
+		parse_jobs = jobs;
+		parse_next = 0;
+		parse_count = n;
+
+		/* signals are left to the main thread */
+		sigfillset(&all);
+		pthread_sigmask(SIG_SETMASK, &all, &mask);
+		for (i = 0; i < nthreads - 1; i++)
+			if (pthread_create(&threads[i], NULL, parse_worker, NULL) != 0)
+				break;
+		pthread_sigmask(SIG_SETMASK, &mask, NULL);
+		Debug(DLOAD, ("[%ld] parsing %d crontabs on %d threads\n",
+				(long) getpid(), n, i + 1));
+
+		(void) parse_worker(NULL);
+		while (i-- > 0)
+			pthread_join(threads[i], NULL);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++)
+		parse_job(&jobs[i]);
+}
+
+static void
+load_dir(const char *dir_name, int spool, cron_db * new_db, cron_db * old_db) {
+	static load_job batch[LOAD_BATCH];
+	uring_file *files[LOAD_BATCH];
+	struct passwd *pw;
+	load_job *j;
+	DIR_T *dp;
+	DIR *dir;
+	int i, m, n, done = FALSE;
+
+	if (!(dir = opendir(dir_name))) {
+		log_it("CRON", getpid(), "OPENDIR FAILED", dir_name, errno);
+		return;
+	}
+
+	while (!done) {
+		for (n = 0; n < LOAD_BATCH; ) {
+			if ((dp = readdir(dir)) == NULL) {
+				done = TRUE;
+				break;
+			}
+			j = &batch[n];
+			if (not_a_crontab(dp->d_name))
+				continue;
+			if (!glue_strings(j->tabname, sizeof j->tabname, dir_name,
+					dp->d_name, '/'))
+				continue;	/* XXX log? */
+
+			/* not_a_crontab() skips longer names */
+			strcpy(j->name, dp->d_name);
+			j->f.path = j->tabname;
+			files[n++] = &j->f;
+		}
+		uring_open(files, n);
+		uring_stat(files, n);
+
+		for (i = m = 0; i < n; i++) {
+			j = &batch[i];
+			j->uname = spool ? j->name : "root";
+			j->fname = spool ? j->name : "*system*";
+			j->pw = NULL;
+			j->same = FALSE;
+			j->f.fd = check_crontab(j->uname, spool ? j->name : NULL,
+				j->tabname, j->f.fd, j->f.stat ? &j->f.st : NULL, new_db,
+				old_db, &j->u, &j->old, &pw, &j->mtime);
+
+			/* pw is good until the next lookup only */
+			if (j->f.fd != -1 && pw != NULL && (j->pw = pw_dup(pw)) == NULL) {
+				log_it(j->uname, getpid(), "FAILED", "loading cron table",
+					errno);
+				close(j->f.fd);
+				j->f.fd = -1;
+				free_user(j->old);
+			}
+
+			/* what the cache has need not be read, unless it is to be
+			 * compared with the old contents
+			 */
+			if (j->f.fd != -1 && j->f.stat && S_ISREG(j->f.st.st_mode) &&
+				(j->old != NULL || !cache_fresh(j->tabname, &j->f.st)))
+				files[m++] = &j->f;
+		}
+		uring_read(files, m);
+
+		parse_batch(batch, n);
+
+		for (i = 0; i < n; i++) {
+			j = &batch[i];
+			if (j->f.fd != -1)
+				replace_crontab(new_db, j->old, j->u, j->same, j->mtime,
+					j->tabname);
+			else if (j->u != NULL)
+				link_user(new_db, j->u);
+			free(j->pw);
+		}
+	}
+	closedir(dir);
 }
 
 static int
 cluster_host_is_local(void)
 {
 	char filename[NAME_MAX+1];
-	int is_local;
-	FILE *f;
+	int is_local, fd;
+	cron_buf buf;
 	char hostname[MAXHOSTNAMELEN], myhostname[MAXHOSTNAMELEN];
 
 	if (!EnableClustering)
@@ -306,16 +711,18 @@ cluster_host_is_local(void)
 
 	is_local = 0;
 	if (glue_strings(filename, sizeof filename, SPOOL_DIR, CRON_HOSTNAME, '/')) {
-		if ((f = fopen(filename, "r"))) {
+		if ((fd = open(filename, O_RDONLY)) >= 0) {
 
-			if (EOF != get_string(hostname, MAXHOSTNAMELEN, f, "\n") &&
+			if (read_buf(fd, &buf) == OK &&
+			    EOF != get_string(hostname, MAXHOSTNAMELEN, &buf, "\n") &&
 			    gethostname(myhostname, MAXHOSTNAMELEN) == 0) {
 				is_local = (strcmp(myhostname, hostname) == 0);
 			} else {
 				Debug(DLOAD, ("cluster: hostname comparison error\n"));
 			}
 
-			fclose(f);
+			free(buf.data);
+			close(fd);
 		} else {
 			Debug(DLOAD, ("cluster: file %s not found\n", filename));
 		}
@@ -325,107 +732,284 @@ cluster_host_is_local(void)
 }
 
 #if defined WITH_INOTIFY
-void check_inotify_database(cron_db * old_db) {
-	cron_db new_db;
-	DIR_T *dp;
-	DIR *dir;
-	struct timeval tv;
-	fd_set rfds;
-	int retval;
-	char buf[BUF_LEN];
-	pid_t pid = getpid();
-	tv.tv_sec = 0;
-	tv.tv_usec = 0;
-
-	FD_ZERO(&rfds);
-	FD_SET(old_db->ifd, &rfds);
+/*
+ * Reload the crontab tabname after inotify reported a change of it,
+ * or drop it if it is gone.
+ */
+static void
+reload_crontab(const char *uname, const char *fname, const char *tabname,
+	cron_db * db) {
+	struct stat statbuf;
+	cron_db old_db;
+	user *u;
 
-	retval = select(old_db->ifd + 1, &rfds, NULL, NULL, &tv);
-	if (retval == -1) {
-		if (errno != EINTR)
-			log_it("CRON", pid, "INOTIFY", "select failed", errno);
-		return;
+	old_db.head = old_db.tail = NULL;
+	old_db.by_name = old_db.by_tab = NULL;
+	old_db.nbuckets = old_db.nusers = 0;
+	old_db.mtime = db->mtime;
+	old_db.ifd = db->ifd;
+	u = find_user(db, fname != NULL ? fname : "*system*",
+		fname != NULL ? NULL : tabname);
+	if (u != NULL) {
+		unlink_user(db, u);
+		link_user(&old_db, u);
 	}
-	else if (FD_ISSET(old_db->ifd, &rfds)) {
-		new_db.head = new_db.tail = NULL;
-		new_db.ifd = old_db->ifd;
-		new_db.mtime = time(NULL) - 1;
-		while ((retval = (int)read(old_db->ifd, buf, sizeof (buf))) == -1 &&
-			errno == EINTR) ;
 
-		if (retval == 0) {
-			/* this should not happen as the buffer is large enough */
-			errno = ENOMEM;
-		}
+	if (stat(tabname, &statbuf) == 0 || errno != ENOENT)
+		process_crontab(uname, fname, tabname, -1, db, &old_db);
 
-		if (retval <= 0) {
-			log_it("CRON", pid, "INOTIFY", "read failed", errno);
-			/* something fatal must have occurred we have no other reasonable
-			 * way how to handle this failure than exit.
-			 */
-			(void) exit(ERROR_EXIT);
-		}
+	while ((u = old_db.head) != NULL) {
+		Debug(DLOAD, ("\t%s: [removed]\n", tabname));
+		unlink_user(&old_db, u);
+		free_user(u);
+	}
+	free(old_db.by_name);
+	free(old_db.by_tab);
+}
 
-		/* we must reinstate the watches here - TODO reinstate only watches
-		 * which get IN_IGNORED event
-		 */
-		set_cron_watched(old_db->ifd);
+/*
+ * Reload the whole database, after inotify lost events or a watched
+ * directory went away.
+ */
+static void rescan_database(cron_db * old_db) {
+	cron_db new_db;
+
+	new_db.head = new_db.tail = NULL;
+	new_db.by_name = new_db.by_tab = NULL;
+	new_db.nbuckets = new_db.nusers = 0;
+	new_db.ifd = old_db->ifd;
+	new_db.mtime = time(NULL) - 1;
 
-		/* TODO: parse the events and read only affected files */
 #if defined ENABLE_SYSCRONTAB
-		process_crontab("root", NULL, SYSCRONTAB, &new_db, old_db);
+	process_crontab("root", NULL, SYSCRONTAB, -1, &new_db, old_db);
 #endif
+	load_dir(SYS_CROND_DIR, FALSE, &new_db, old_db);
+	load_dir(SPOOL_DIR, TRUE, &new_db, old_db);
+
+	overwrite_database(old_db, &new_db);
+}
+
+/*
+ * Changes reported by inotify are not applied one by one, but together
+ * once they have stopped coming for ReloadDelay seconds, or have been
+ * coming for RELOAD_MAX_DELAY.  A package manager or configuration
+ * management writing many files at once then causes one reload.
+ */
+#define RELOAD_MAX_DELAY	60
+#define RELOAD_MAX_PENDING	65536	/* more changes are read in full */
 
-		if (!(dir = opendir(SYS_CROND_DIR))) {
-			log_it("CRON", pid, "OPENDIR FAILED", SYS_CROND_DIR, errno);
+typedef struct _pending_change {
+	const char	*path;		/* watched path */
+	char		*name;		/* name in it, NULL for the file itself */
+} pending_change;
+
+static pending_change *pending;
+static int npending, pending_size, pending_rescan;
+static time_t pending_first, pending_last;
+
+static void drop_pending(void) {
+	int i;
+
+	for (i = 0; i < npending; i++)
+		free(pending[i].name);
+	npending = 0;
+	pending_rescan = FALSE;
+}
+
+static void add_pending(const char *path, const char *name) {
+	pending_change *pc;
+
+	if (pending_rescan)
+		return;
+	if (npending == pending_size) {
+		int size = pending_size ? 2 * pending_size : 64;
+
+		if (size > RELOAD_MAX_PENDING ||
+			(pc = realloc(pending, (size_t) size * sizeof (*pc))) == NULL) {
+			drop_pending();
+			pending_rescan = TRUE;
+			return;
 		}
-		else {
-			while (NULL != (dp = readdir(dir))) {
-				char tabname[NAME_MAX + 1];
+		pending = pc;
+		pending_size = size;
+	}
+	pc = &pending[npending];
+	pc->path = path;
+	pc->name = NULL;
+	if (name != NULL && (pc->name = strdup(name)) == NULL) {
+		drop_pending();
+		pending_rescan = TRUE;
+		return;
+	}
+	npending++;
+}
+
+static int compare_pending(const void *a, const void *b) {
+	const pending_change *pa = a, *pb = b;
+	int c;
+
+	if ((c = strcmp(pa->path, pb->path)) != 0)
+		return (c);
+	if (pa->name == NULL || pb->name == NULL)
+		return (pa->name == NULL) - (pb->name == NULL);
+	return (strcmp(pa->name, pb->name));
+}
+
+/*
+ * Return the time at which the changes read so far are applied,
+ * or 0 if there are none.
+ */
+time_t inotify_reload_time(void) {
+	time_t when;
+
+	if (npending == 0 && !pending_rescan)
+		return (0);
+	when = pending_last + ReloadDelay;
+	return (TMIN(when, pending_first + RELOAD_MAX_DELAY));
+}
+
+static void read_events(cron_db * old_db, int waited) {
+	struct inotify_event ev;
+	int retval, missing, rewatch = FALSE;
+	char buf[BUF_LEN], *p;
+	const char *path, *name;
+	pid_t pid = getpid();
+
+	while ((retval = (int)read(old_db->ifd, buf, sizeof (buf))) == -1 &&
+		errno == EINTR) ;
+
+	if (retval == 0) {
+		/* this should not happen as the buffer is large enough */
+		errno = ENOMEM;
+	}
+
+	if (retval <= 0) {
+		log_it("CRON", pid, "INOTIFY", "read failed", errno);
+		/* something fatal must have occurred we have no other reasonable
+		 * way how to handle this failure than exit.
+		 */
+		(void) exit(ERROR_EXIT);
+	}
 
-				if (not_a_crontab(dp))
-					continue;
+	/* events which waited for the tick may be a minute old already */
+	if (npending == 0 && !pending_rescan)
+		pending_first = time(NULL);
+	pending_last = waited ? time(NULL) - ReloadDelay : time(NULL);
 
-				if (!glue_strings(tabname, sizeof tabname, SYS_CROND_DIR,
-						dp->d_name, '/'))
-					continue;
-				process_crontab("root", NULL, tabname, &new_db, old_db);
+	for (p = buf; p + EVENT_SIZE <= buf + retval; p += EVENT_SIZE + ev.len) {
+		memcpy(&ev, p, EVENT_SIZE);
+		if (p + EVENT_SIZE + ev.len > buf + retval)
+			break;
+		if (ev.mask & IN_Q_OVERFLOW) {
+			Debug(DLOAD, ("[%ld] inotify queue overflow\n", (long) pid));
+			drop_pending();
+			pending_rescan = TRUE;
+			continue;
+		}
+		if ((path = cron_watched_path(ev.wd)) == NULL)
+			continue;
+		name = ev.len > 0 ? p + EVENT_SIZE : NULL;
+
+		/* the watch is gone with the file or directory it was on */
+		if (ev.mask & IN_IGNORED) {
+			rewatch = TRUE;
+			if (strcmp(path, SYSCRONTAB) != 0) {
+				drop_pending();
+				pending_rescan = TRUE;
 			}
-			closedir(dir);
 		}
+		if (name == NULL ? strcmp(path, SYSCRONTAB) != 0 : not_a_crontab(name))
+			continue;
+		add_pending(path, name);
+	}
 
-		if (!(dir = opendir(SPOOL_DIR))) {
-			log_it("CRON", pid, "OPENDIR FAILED", SPOOL_DIR, errno);
+	/* watches are added again only when one was lost; what shows up
+	 * where nothing could be watched has to be read in full
+	 */
+	missing = cron_watches_missing();
+	if (rewatch || missing > 0) {
+		set_cron_watched(old_db->ifd);
+		if (cron_watches_missing() < missing) {
+			drop_pending();
+			pending_rescan = TRUE;
 		}
-		else {
-			while (NULL != (dp = readdir(dir))) {
-				char fname[NAME_MAX + 1], tabname[NAME_MAX + 1];
+	}
+}
 
-				if (not_a_crontab(dp))
-					continue;
+static void apply_pending(cron_db * old_db) {
+	const pending_change *pc;
+	int i;
 
-				strncpy(fname, dp->d_name, NAME_MAX + 1);
+	begin_user_lookups();
+	cache_begin();
+	if (pending_rescan) {
+		Debug(DLOAD, ("[%ld] rescanning the database\n", (long) getpid()));
+		rescan_database(old_db);
+	}
+	else {
+		Debug(DLOAD, ("[%ld] %d changes to apply\n", (long) getpid(),
+				npending));
+		qsort(pending, (size_t) npending, sizeof (*pending), compare_pending);
+		old_db->mtime = time(NULL) - 1;
+		for (i = 0; i < npending; i++) {
+			char tabname[NAME_MAX + 1];
 
-				if (!glue_strings(tabname, sizeof tabname, SPOOL_DIR,
-						dp->d_name, '/'))
-					continue;
-				process_crontab(fname, fname, tabname, &new_db, old_db);
+			pc = &pending[i];
+			if (i > 0 && compare_pending(pc, pc - 1) == 0)
+				continue;
+			if (pc->name == NULL) {
+				reload_crontab("root", NULL, pc->path, old_db);
+				continue;
 			}
-			closedir(dir);
+			if (!glue_strings(tabname, sizeof tabname, pc->path,
+					pc->name, '/'))
+				continue;
+			if (strcmp(pc->path, SPOOL_DIR) == 0)
+				reload_crontab(pc->name, pc->name, tabname, old_db);
+			else
+				reload_crontab("root", NULL, tabname, old_db);
 		}
-
-		/* if we don't do this, then when our children eventually call
-		 * getpwnam() in do_command.c's child_process to verify MAILTO=,
-		 * they will screw us up (and v-v).
-		 */
-		endpwent();
 	}
-	else {
-		/* just return as no db reload is needed */
+	drop_pending();
+	cache_end(old_db);
+
+	/* if we don't do this, then when our children eventually call
+	 * getpwnam() in do_command.c's child_process to verify MAILTO=,
+	 * they will screw us up (and v-v).
+	 */
+	end_user_lookups();
+	endpwent();
+}
+
+/*
+ * Read what inotify has to report, and apply the changes which are due.
+ * If waited is set, the events were not read as they came but at the
+ * tick, and count as settled.
+ */
+void check_inotify_database(cron_db * old_db, int waited) {
+	struct timeval tv;
+	fd_set rfds;
+	int retval;
+	time_t when;
+	pid_t pid = getpid();
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+
+	FD_ZERO(&rfds);
+	FD_SET(old_db->ifd, &rfds);
+
+	retval = select(old_db->ifd + 1, &rfds, NULL, NULL, &tv);
+	if (retval == -1) {
+		if (errno != EINTR)
+			log_it("CRON", pid, "INOTIFY", "select failed", errno);
 		return;
 	}
+	else if (FD_ISSET(old_db->ifd, &rfds))
+		read_events(old_db, waited);
 
-	overwrite_database(old_db, &new_db);
+	if ((when = inotify_reload_time()) == 0 || when > time(NULL))
+		return;
+	apply_pending(old_db);
 	Debug(DLOAD, ("check_inotify_database is done\n"));
 }
 #endif
@@ -441,6 +1025,8 @@ static void overwrite_database(cron_db * old_db, cron_db * new_db) {
 		unlink_user(old_db, u);
 		free_user(u);
 	}
+	free(old_db->by_name);
+	free(old_db->by_tab);
 
 	/* overwrite the database control block with the new one.
 	 */
@@ -450,16 +1036,24 @@ static void overwrite_database(cron_db * old_db, cron_db * new_db) {
 int load_database(cron_db * old_db) {
 	struct stat statbuf, syscron_stat, crond_stat;
 	cron_db new_db;
-	DIR_T *dp;
-	DIR *dir;
 	pid_t pid = getpid();
-	int is_local = 0;
-	time_t now;
+	int is_local = 0, full_scan;
+	time_t now, newest;
 
 	Debug(DLOAD, ("[%ld] load_database()\n", (long) pid));
 
 	now = time(NULL);
 
+	/* crontab(1) updates the mtime of SPOOL_DIR when it changes a
+	 * crontab, so every crontab of it is looked at only each
+	 * FullScanInterval seconds, for changes made behind its back.
+	 * The system crontabs are edited in place and looked at every time.
+	 */
+	full_scan = old_db->mtime == 0 || FullScanInterval == 0 ||
+		now >= next_full_scan || next_full_scan - now > FullScanInterval;
+	if (full_scan)
+		next_full_scan = now + FullScanInterval;
+
 	/* before we start loading any data, do a stat on SPOOL_DIR
 	 * so that if anything changes as of this moment (i.e., before we've
 	 * cached any of the database), we'll see the changes next time.
@@ -468,7 +1062,7 @@ int load_database(cron_db * old_db) {
 		log_it("CRON", pid, "STAT FAILED", SPOOL_DIR, errno);
 		statbuf.st_mtime = 0;
 	}
-	else {
+	else if (full_scan) {
 		max_mtime(SPOOL_DIR, &statbuf);
 	}
 
@@ -495,93 +1089,118 @@ int load_database(cron_db * old_db) {
 	 * We also use now - 1 as the upper bound of timestamp to avoid race,
 	 * when a crontab is updated twice in a single second when we are
          * just reading it.
+	 *
+	 * Between full scans SPOOL_DIR itself stands for its crontabs; it
+	 * is not newer than the last load unless something changed.
 	 */
+	newest = TMAX(crond_stat.st_mtime,
+		TMAX(statbuf.st_mtime, syscron_stat.st_mtime));
 	if (old_db->mtime != 0
-	    && old_db->mtime == TMIN(now - 1,
-				     TMAX(crond_stat.st_mtime,
-					  TMAX(statbuf.st_mtime, syscron_stat.st_mtime)))
+	    && (full_scan ? old_db->mtime == TMIN(now - 1, newest)
+		: old_db->mtime >= TMIN(now - 1, newest))
 		) {
 		Debug(DLOAD, ("[%ld] spool dir mtime unch, no load needed.\n",
 				(long) pid));
 		return 0;
 	}
 
+#if defined WITH_INOTIFY
+	/* a full load covers what inotify reported */
+	drop_pending();
+#endif
+
 	/* something's different.  make a new database, moving unchanged
 	 * elements from the old database, reloading elements that have
 	 * actually changed.  Whatever is left in the old database when
 	 * we're done is chaff -- crontabs that disappeared.
 	 */
-	new_db.mtime = now - 1;
+	new_db.mtime = TMIN(now - 1, newest);
 	new_db.head = new_db.tail = NULL;
+	new_db.by_name = new_db.by_tab = NULL;
+	new_db.nbuckets = new_db.nusers = 0;
 #if defined WITH_INOTIFY
 	new_db.ifd = old_db->ifd;
 #endif
+	begin_user_lookups();
+	cache_begin();
 
 #if defined ENABLE_SYSCRONTAB
 	if (syscron_stat.st_mtime)
-		process_crontab("root", NULL, SYSCRONTAB, &new_db, old_db);
+		process_crontab("root", NULL, SYSCRONTAB, -1, &new_db, old_db);
 #endif
 
-	if (!(dir = opendir(SYS_CROND_DIR))) {
-		log_it("CRON", pid, "OPENDIR FAILED", SYS_CROND_DIR, errno);
-	}
-	else {
-		while (NULL != (dp = readdir(dir))) {
-			char tabname[NAME_MAX + 1];
-
-			if (not_a_crontab(dp))
-				continue;
-
-			if (!glue_strings(tabname, sizeof tabname, SYS_CROND_DIR,
-					dp->d_name, '/'))
-				continue;	/* XXX log? */
-
-			process_crontab("root", NULL, tabname, &new_db, old_db);
-		}
-		closedir(dir);
-	}
+	load_dir(SYS_CROND_DIR, FALSE, &new_db, old_db);
 
 	/* we used to keep this dir open all the time, for the sake of
 	 * efficiency.  however, we need to close it in every fork, and
 	 * we fork a lot more often than the mtime of the dir changes.
 	 */
-
-	if (!(dir = opendir(SPOOL_DIR))) {
-		log_it("CRON", pid, "OPENDIR FAILED", SPOOL_DIR, errno);
-	}
-	else {
-
-		is_local = cluster_host_is_local();
-
-		while (is_local && NULL != (dp = readdir(dir))) {
-			char fname[NAME_MAX + 1], tabname[NAME_MAX + 1];
-
-			if (not_a_crontab(dp))
-				continue;
-
-			strncpy(fname, dp->d_name, NAME_MAX);
-			fname[NAME_MAX] = '\0';
-
-			if (!glue_strings(tabname, sizeof tabname, SPOOL_DIR, fname, '/'))
-				continue;	/* XXX log? */
-
-			process_crontab(fname, fname, tabname, &new_db, old_db);
-		}
-		closedir(dir);
-	}
+	is_local = cluster_host_is_local();
+	if (is_local)
+		load_dir(SPOOL_DIR, TRUE, &new_db, old_db);
 
 	/* if we don't do this, then when our children eventually call
 	 * getpwnam() in do_command.c's child_process to verify MAILTO=,
 	 * they will screw us up (and v-v).
 	 */
+	end_user_lookups();
 	endpwent();
 
 	overwrite_database(old_db, &new_db);
+	cache_end(old_db);
 	Debug(DLOAD, ("load_database is done\n"));
 	return 1;
 }
 
+/*
+ * The users of a database are hashed by name and by crontab file name,
+ * so that find_user() does not walk the list.  Without the hash (no
+ * memory for it), the list is walked as before.
+ */
+static unsigned hash_string(const char *s) {
+	unsigned h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char) *s++) * 16777619u;
+	return (h);
+}
+
+static void hash_user(cron_db * db, user * u) {
+	user **bp;
+
+	bp = &db->by_name[hash_string(u->name) % (unsigned) db->nbuckets];
+	u->name_next = *bp;
+	*bp = u;
+	bp = &db->by_tab[hash_string(u->tabname) % (unsigned) db->nbuckets];
+	u->tab_next = *bp;
+	*bp = u;
+}
+
+static int grow_index(cron_db * db) {
+	int size = db->nbuckets ? 2 * db->nbuckets : 64;
+	user **by_name, **by_tab, *u;
+
+	if ((by_name = calloc((size_t) size, sizeof (*by_name))) == NULL)
+		return (FALSE);
+	if ((by_tab = calloc((size_t) size, sizeof (*by_tab))) == NULL) {
+		free(by_name);
+		return (FALSE);
+	}
+	free(db->by_name);
+	free(db->by_tab);
+	db->by_name = by_name;
+	db->by_tab = by_tab;
+	db->nbuckets = size;
+	for (u = db->head; u != NULL; u = u->next)
+		hash_user(db, u);
+	return (TRUE);
+}
+
 void link_user(cron_db * db, user * u) {
+	static unsigned long linked;
+
+	/* users are only ever appended, so this follows the list */
+	u->order = ++linked;
 	if (db->head == NULL)
 		db->head = u;
 	if (db->tail)
@@ -589,9 +1208,16 @@ void link_user(cron_db * db, user * u) {
 	u->prev = db->tail;
 	u->next = NULL;
 	db->tail = u;
+
+	/* grow_index() hashes u as well */
+	if (++db->nusers <= db->nbuckets || !grow_index(db))
+		if (db->nbuckets > 0)
+			hash_user(db, u);
 }
 
 void unlink_user(cron_db * db, user * u) {
+	user **bp;
+
 	if (u->prev == NULL)
 		db->head = u->next;
 	else
@@ -601,22 +1227,56 @@ void unlink_user(cron_db * db, user * u) {
 		db->tail = u->prev;
 	else
 		u->next->prev = u->prev;
+
+	db->nusers--;
+	if (db->nbuckets == 0)
+		return;
+	for (bp = &db->by_name[hash_string(u->name) % (unsigned) db->nbuckets];
+		*bp != NULL; bp = &(*bp)->name_next)
+		if (*bp == u) {
+			*bp = u->name_next;
+			break;
+		}
+	for (bp = &db->by_tab[hash_string(u->tabname) % (unsigned) db->nbuckets];
+		*bp != NULL; bp = &(*bp)->tab_next)
+		if (*bp == u) {
+			*bp = u->tab_next;
+			break;
+		}
 }
 
 user *find_user(cron_db * db, const char *name, const char *tabname) {
 	user *u;
 
-	for (u = db->head; u != NULL; u = u->next)
-		if ((strcmp(u->name, name) == 0)
-			&& ((tabname == NULL)
-				|| (strcmp(tabname, u->tabname) == 0)
-			)
-			)
+	if (db->nbuckets == 0) {
+		for (u = db->head; u != NULL; u = u->next)
+			if ((strcmp(u->name, name) == 0)
+				&& ((tabname == NULL)
+					|| (strcmp(tabname, u->tabname) == 0)
+				)
+				)
+				break;
+		return (u);
+	}
+
+	/* the first user linked of a name, as the list walk would find */
+	if (tabname == NULL) {
+		user *found = NULL;
+
+		for (u = db->by_name[hash_string(name) % (unsigned) db->nbuckets];
+			u != NULL; u = u->name_next)
+			if (strcmp(u->name, name) == 0)
+				found = u;
+		return (found);
+	}
+	for (u = db->by_tab[hash_string(tabname) % (unsigned) db->nbuckets];
+		u != NULL; u = u->tab_next)
+		if (strcmp(u->tabname, tabname) == 0 && strcmp(u->name, name) == 0)
 			break;
 	return (u);
 }
 
-static int not_a_crontab(DIR_T * dp) {
+static int not_a_crontab(const char *name) {
 	size_t len;
 
 	/* avoid file names beginning with ".".  this is good
@@ -624,30 +1284,30 @@ static int not_a_crontab(DIR_T * dp) {
 	 * to getpwnam() for . and .., and there shouldn't be 
 	 * hidden files in here anyway
 	 */
-	if (dp->d_name[0] == '.')
+	if (name[0] == '.')
 		return (1);
 
 	/* ignore files starting with # and ending with ~ */
-	if (dp->d_name[0] == '#')
+	if (name[0] == '#')
 		return (1);
 
 	/* ignore CRON_HOSTNAME file (in case doesn't start with ".")  */
-	if (0 == strcmp(dp->d_name, CRON_HOSTNAME))
+	if (0 == strcmp(name, CRON_HOSTNAME))
 		return(1);
 
-	len = strlen(dp->d_name);
+	len = strlen(name);
 
 	if (len >= NAME_MAX || len == 0)
 		return (1);
 
-	if (dp->d_name[len - 1] == '~')
+	if (name[len - 1] == '~')
 		return (1);
 
-	if ((len > 8) && (strncmp(dp->d_name + len - 8, ".rpmsave", 8) == 0))
+	if ((len > 8) && (strncmp(name + len - 8, ".rpmsave", 8) == 0))
 		return (1);
-	if ((len > 8) && (strncmp(dp->d_name + len - 8, ".rpmorig", 8) == 0))
+	if ((len > 8) && (strncmp(name + len - 8, ".rpmorig", 8) == 0))
 		return (1);
-	if ((len > 7) && (strncmp(dp->d_name + len - 7, ".rpmnew", 7) == 0))
+	if ((len > 7) && (strncmp(name + len - 7, ".rpmnew", 7) == 0))
 		return (1);
 
 	return (0);
@@ -666,7 +1326,7 @@ static void max_mtime(const char *dir_name, struct stat *max_st) {
 	while (NULL != (dp = readdir(dir))) {
 		char tabname[NAME_MAX + 1];
 
-		if ( not_a_crontab ( dp ) && strcmp(dp->d_name, CRON_HOSTNAME) != 0)
+		if ( not_a_crontab(dp->d_name) && strcmp(dp->d_name, CRON_HOSTNAME) != 0)
 			continue;
 
 		if (!glue_strings(tabname, sizeof tabname, dir_name, dp->d_name, '/'))
@@ -46,7 +46,7 @@ static int child_process(entry *, char **);
 static int safe_p(const char *, const char *);
 
 void do_command(entry * e, user * u) {
-	pid_t pid = getpid();
+	pid_t pid = getpid(), child;
 	int ev;
 	char **jobenv = NULL;
 
@@ -61,12 +61,13 @@ void do_command(entry * e, user * u) {
 		 * vfork() is unsuitable, since we have much to do, and the parent
 		 * needs to be able to run off and fork other processes.
 		 */
-		switch (fork()) {
+		switch (child = fork()) {
 	case -1:
 		log_it("CRON", pid, "CAN'T FORK", "do_command", errno);
 		break;
 	case 0:
 		/* child process */
+		unblock_signals();
 		acquire_daemonlock(1);
 		/* Set up the Red Hat security context for both mail/minder and job processes:
 		 */
@@ -83,6 +84,7 @@ void do_command(entry * e, user * u) {
 		break;
 	default:
 		/* parent process */
+		watch_child(child);
 		break;
 	}
 	Debug(DPROC, ("[%ld] main process returning to work\n", (long) pid));
@@ -44,12 +44,13 @@
 #include "pathnames.h"
 
 typedef enum ecode {
-	e_none, e_minute, e_hour, e_dom, e_month, e_dow,
+	e_none, e_second, e_minute, e_hour, e_dom, e_month, e_dow,
 	e_cmd, e_timespec, e_username, e_option, e_memory
 } ecode_e;
 
 static const char *ecodes[] = {
 	"no error",
+	"bad second",
 	"bad minute",
 	"bad hour",
 	"bad day-of-month",
@@ -75,22 +76,185 @@ typedef enum {
 	R_FINISH,
 } range_state_t;
 
-static int get_list(bitstr_t *, int, int, const char *[], int, FILE *),
-get_range(bitstr_t *, int, int, const char *[], FILE *),
-get_number(int *, int, const char *[], FILE *),
+static int get_list(bitstr_t *, int, int, const char *[], int, cron_buf *),
+get_range(bitstr_t *, int, int, const char *[], cron_buf *),
+get_number(int *, int, const char *[], cron_buf *),
 set_element(bitstr_t *, int, int, int);
 
+/* return the interned zone of the given CRON_TZ value, or NULL if out
+ * of memory
+ */
+cron_zone *intern_zone(const char *name) {
+	static cron_zone *zones;
+	DEFINE_LOCK(zones_lock);
+	cron_zone *z;
+
+	LOCK(&zones_lock);
+	for (z = zones; z != NULL; z = z->next)
+		if (strcmp(z->name, name) == 0)
+			break;
+
+	if (z == NULL && (z = calloc(1, sizeof (*z))) != NULL) {
+		if ((z->name = strdup(name)) == NULL) {
+			free(z);
+			z = NULL;
+		}
+		else {
+			z->when = (time_t) -1;
+			z->next = zones;
+			zones = z;
+		}
+	}
+	UNLOCK(&zones_lock);
+	return (z);
+}
+
 void free_entry(entry * e) {
 	free(e->cmd);
-	free(e->pwd);
-	env_free(e->envp);
+	pw_release(e->pwd);
+	env_release(e->envp);
 	free(e);
 }
 
+/* would a and b run the same job at the same times? */
+int same_entry(const entry * a, const entry * b) {
+	return (strcmp(a->cmd, b->cmd) == 0 &&
+		a->flags == b->flags && a->delay == b->delay && a->tz == b->tz &&
+		memcmp(a->second, b->second, sizeof a->second) == 0 &&
+		memcmp(a->minute, b->minute, sizeof a->minute) == 0 &&
+		memcmp(a->hour, b->hour, sizeof a->hour) == 0 &&
+		memcmp(a->dom, b->dom, sizeof a->dom) == 0 &&
+		memcmp(a->month, b->month, sizeof a->month) == 0 &&
+		memcmp(a->dow, b->dow, sizeof a->dow) == 0 &&
+		pw_same(a->pwd, b->pwd) &&
+		a->envp == b->envp);	/* interned */
+}
+
+/* glue name=value into the buffer from *sp to end, past the strings
+ * already there, and return it; or NULL if there is no room
+ */
+static char *add_var(char **sp, char *end, const char *name,
+	const char *value) {
+	char *s = *sp;
+
+	if (!glue_strings(s, (size_t) (end - s), name, value, '='))
+		return (NULL);
+	*sp = s + strlen(s) + 1;
+	return (s);
+}
+
+/* set up what e takes from its owner pw and from the environment envp
+ * of the crontab, after its schedule has been parsed
+ */
+static ecode_e fix_entry(entry * e, struct passwd *pw, char **envp) {
+	char envstr[MAX_ENVSTR], *s = envstr, *end = envstr + sizeof envstr;
+	const char **vars;
+	size_t count;
+	char *p, *var;
+
+	if ((e->pwd = pw_share(pw)) == NULL) {
+		return (e_memory);
+	}
+
+	p = env_get("CRON_TZ", envp);
+	if (p && (e->tz = intern_zone(p)) == NULL) {
+		return (e_memory);
+	}
+
+	p = env_get("RANDOM_DELAY", envp);
+	if (p) {
+		char *endptr;
+		long val;
+
+		errno = 0;    /* To distinguish success/failure after call */
+		val = strtol(p, &endptr, 10);
+		if (errno != 0 || val < 0 || val > 24*60) {
+			log_it("CRON", getpid(), "ERROR", "bad value of RANDOM_DELAY", 0);
+		} else {
+			e->delay = (int)((double)val * RandomScale);
+		}
+	}
+
+	/* fix up a copy of the environment, shared with the entries which
+	 * end up with the same.  some variables are just defaults and
+	 * others are overrides.
+	 */
+	for (count = 0; envp[count] != NULL; count++) ;
+	if ((vars = malloc((count + 6) * sizeof (*vars))) == NULL) {
+		return (e_memory);
+	}
+	memcpy(vars, envp, count * sizeof (*vars));
+	if (!env_get("SHELL", envp)) {
+		if ((var = add_var(&s, end, "SHELL", _PATH_BSHELL)) != NULL)
+			vars[count++] = var;
+		else
+			log_it("CRON", getpid(), "ERROR", "can't set SHELL", 0);
+	}
+	if (pw->pw_dir != NULL && *pw->pw_dir != '\0' && !env_get("HOME", envp)) {
+		if ((var = add_var(&s, end, "HOME", pw->pw_dir)) != NULL)
+			vars[count++] = var;
+		else
+			log_it("CRON", getpid(), "ERROR", "can't set HOME", 0);
+	}
+#ifndef LOGIN_CAP
+	/* If login.conf is in used we will get the default PATH later. */
+	if (!env_get("PATH", envp)) {
+		char *defpath;
+
+		if (ChangePath)
+			defpath = _PATH_STDPATH;
+		else {
+			defpath = getenv("PATH");
+			if (defpath == NULL)
+				defpath = _PATH_STDPATH;
+		}
+
+		if ((var = add_var(&s, end, "PATH", defpath)) != NULL)
+			vars[count++] = var;
+		else
+			log_it("CRON", getpid(), "ERROR", "can't set PATH", 0);
+	}
+#endif /* LOGIN_CAP */
+	if ((var = add_var(&s, end, "LOGNAME", pw->pw_name)) != NULL)
+		env_put(vars, &count, var);
+	else
+		log_it("CRON", getpid(), "ERROR", "can't set LOGNAME", 0);
+#if defined(BSD) || defined(__linux)
+	if ((var = add_var(&s, end, "USER", pw->pw_name)) != NULL)
+		env_put(vars, &count, var);
+	else
+		log_it("CRON", getpid(), "ERROR", "can't set USER", 0);
+#endif
+	vars[count] = NULL;
+	e->envp = env_intern(vars);
+	free(vars);
+	if (e->envp == NULL) {
+		return (e_memory);
+	}
+	return (e_none);
+}
+
+/* set up e, read from the crontab cache, as load_entry() would for the
+ * owner pw, or for the user uname of a system crontab if pw is NULL.
+ * Return FALSE if out of memory.
+ */
+int cached_entry(entry * e, const char *uname, struct passwd *pw,
+	char **envp) {
+	struct passwd temppw;
+
+	if (pw == NULL && (pw = lookup_user(uname)) == NULL) {
+		memset(&temppw, 0, sizeof (temppw));
+		temppw.pw_name = (char *) uname;
+		temppw.pw_passwd = "";
+		pw = &temppw;
+	}
+	return (fix_entry(e, pw, envp) == e_none);
+}
+
 /* return NULL if eof or syntax error occurs;
  * otherwise return a pointer to a new entry.
  */
-entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd *pw,
+entry *load_entry(cron_buf * file, void (*error_func) (const char *), struct passwd *pw,
 	char **envp) {
 	/* this function reads one crontab entry -- the next -- from a file.
 	 * it skips any leading blank lines, ignores comments, and returns
@@ -103,14 +267,15 @@ entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd
 	 *  minutes hours doms months dows cmd\n
 	 *   system crontab (/etc/crontab):
 	 *  minutes hours doms months dows USERNAME cmd\n
+	 *
+	 * with CRON_SECONDS=yes set, the numeric forms start with a
+	 * field of seconds.
 	 */
 
 	ecode_e ecode = e_none;
 	entry *e = NULL;
 	int ch;
 	char cmd[MAX_COMMAND];
-	char envstr[MAX_ENVSTR];
-	char **tenvp;
 	char *p;
 	struct passwd temppw;
 	int i;
@@ -225,6 +390,19 @@ entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd
 	else {
 		Debug(DPARS, ("load_entry()...about to parse numerics\n"));
 
+		p = env_get("CRON_SECONDS", envp);
+		if (p && (strcmp(p, "yes") == 0 || strcmp(p, "1") == 0)) {
+			ch = get_list(e->second, FIRST_SECOND, LAST_SECOND, PPC_NULL, ch, file);
+			if (ch == EOF) {
+				ecode = e_second;
+				goto eof;
+			}
+			/* just second 0 is what the minute tick does anyway */
+			for (i = FIRST_SECOND + 1; i <= LAST_SECOND; i++)
+				if (bit_test(e->second, i - FIRST_SECOND))
+					e->flags |= SEC_FIELD;
+		}
+
 		if (ch == '*')
 			e->flags |= MIN_STAR;
 		ch = get_list(e->minute, FIRST_MINUTE, LAST_MINUTE, PPC_NULL, ch, file);
@@ -303,7 +481,7 @@ entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd
 			goto eof;
 		}
 
-		pw = getpwnam(username);
+		pw = lookup_user(username);
 		if (pw == NULL) {
 			Debug(DPARS, ("load_entry()...unknown user entry\n"));
 			memset(&temppw, 0, sizeof (temppw));
@@ -327,93 +505,8 @@ entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd
 		unget_char(ch, file);
 	}
 
-	if ((e->pwd = pw_dup(pw)) == NULL) {
-		ecode = e_memory;
+	if ((ecode = fix_entry(e, pw, envp)) != e_none)
 		goto eof;
-	}
-	memset(e->pwd->pw_passwd, 0, strlen(e->pwd->pw_passwd));
-
-	p = env_get("RANDOM_DELAY", envp);
-	if (p) {
-		char *endptr;
-		long val;
-
-		errno = 0;    /* To distinguish success/failure after call */
-		val = strtol(p, &endptr, 10);
-		if (errno != 0 || val < 0 || val > 24*60) {
-			log_it("CRON", getpid(), "ERROR", "bad value of RANDOM_DELAY", 0);
-		} else {
-			e->delay = (int)((double)val * RandomScale);
-		}
-	}
-
-	/* copy and fix up environment.  some variables are just defaults and
-	 * others are overrides.
-	 */
-	if ((e->envp = env_copy(envp)) == NULL) {
-		ecode = e_memory;
-		goto eof;
-	}
-	if (!env_get("SHELL", e->envp)) {
-		if (glue_strings(envstr, sizeof envstr, "SHELL", _PATH_BSHELL, '=')) {
-			if ((tenvp = env_set(e->envp, envstr)) == NULL) {
-				ecode = e_memory;
-				goto eof;
-			}
-			e->envp = tenvp;
-		}
-		else
-			log_it("CRON", getpid(), "ERROR", "can't set SHELL", 0);
-	}
-	if ((tenvp = env_update_home(e->envp, pw->pw_dir)) == NULL) {
-		ecode = e_memory;
-		goto eof;
-	}
-	e->envp = tenvp;
-#ifndef LOGIN_CAP
-	/* If login.conf is in used we will get the default PATH later. */
-	if (!env_get("PATH", e->envp)) {
-		char *defpath;
-
-		if (ChangePath)
-			defpath = _PATH_STDPATH;
-		else {
-			defpath = getenv("PATH");
-			if (defpath == NULL)
-				defpath = _PATH_STDPATH;
-		}
-
-		if (glue_strings(envstr, sizeof envstr, "PATH", defpath, '=')) {
-			if ((tenvp = env_set(e->envp, envstr)) == NULL) {
-				ecode = e_memory;
-				goto eof;
-			}
-			e->envp = tenvp;
-		}
-		else
-			log_it("CRON", getpid(), "ERROR", "can't set PATH", 0);
-	}
-#endif /* LOGIN_CAP */
-	if (glue_strings(envstr, sizeof envstr, "LOGNAME", pw->pw_name, '=')) {
-		if ((tenvp = env_set(e->envp, envstr)) == NULL) {
-			ecode = e_memory;
-			goto eof;
-		}
-		e->envp = tenvp;
-	}
-	else
-		log_it("CRON", getpid(), "ERROR", "can't set LOGNAME", 0);
-#if defined(BSD) || defined(__linux)
-	if (glue_strings(envstr, sizeof envstr, "USER", pw->pw_name, '=')) {
-		if ((tenvp = env_set(e->envp, envstr)) == NULL) {
-			ecode = e_memory;
-			goto eof;
-		}
-		e->envp = tenvp;
-	}
-	else
-		log_it("CRON", getpid(), "ERROR", "can't set USER", 0);
-#endif
 
 	Debug(DPARS, ("load_entry()...about to parse command\n"));
 
@@ -476,13 +569,12 @@ entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd
 
   eof:
 	if (e) {
-		if (e->envp)
-			env_free(e->envp);
-		free(e->pwd);
+		env_release(e->envp);
+		pw_release(e->pwd);
 		free(e->cmd);
 		free(e);
 	}
-	for (i = 0; i < MAX_COMMAND && ch != '\n' && !feof(file); i++)
+	for (i = 0; i < MAX_COMMAND && ch != '\n' && file->p < file->end; i++)
 		ch = get_char(file);
 	if (ecode != e_none && error_func)
 		(*error_func) (ecodes[(int) ecode]);
@@ -491,7 +583,7 @@ entry *load_entry(FILE * file, void (*error_func) (const char *), struct passwd
 
 static int
 get_list(bitstr_t * bits, int low, int high, const char *names[],
-	int ch, FILE * file) {
+	int ch, cron_buf * file) {
 	int done;
 
 	/* we know that we point to a non-blank character here;
@@ -549,7 +641,7 @@ inline static int is_separator(int ch) {
 
 static int
 get_range(bitstr_t * bits, int low, int high, const char *names[],
-		FILE * file) {
+		cron_buf * file) {
 	/* range = number | number "-" number [ "/" number ]
 	 *         | [number] "~" [number]
 	 */
@@ -695,7 +787,7 @@ get_range(bitstr_t * bits, int low, int high, const char *names[],
 }
 
 static int
-get_number(int *numptr, int low, const char *names[], FILE * file) {
+get_number(int *numptr, int low, const char *names[], cron_buf * file) {
 	char temp[MAX_TEMPSTR], *pc;
 	int len, i, ch;
 	char *endptr;
@@ -722,7 +814,9 @@ get_number(int *numptr, int low, const char *names[], FILE * file) {
 		return 0;
 	}
 
-	/* no numbers, look for a string if we have any */
+	/* no numbers, look for a string if we have any; ch is back in
+	 * the buffer already
+	 */
 	if (names) {
 		for (i = 0; names[i] != NULL; i++) {
 			Debug(DPARS | DEXT, ("get_num, compare(%s,%s)\n", names[i], temp));
@@ -731,9 +825,8 @@ get_number(int *numptr, int low, const char *names[], FILE * file) {
 				return 0;
 			}
 		}
-	} else {
-		goto bad;
 	}
+	return (EOF);
 
   bad:
 	unget_char(ch, file);
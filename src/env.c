@@ -163,6 +163,163 @@ int env_set_from_environ(char ***envpp) {
 	return TRUE;
 }
 
+/*
+ * The environments of entries are interned: entries with the same
+ * variables share one block, holding the array and its strings, which
+ * is freed with the last of them.  Most entries of a crontab end up with
+ * the same environment.  A shared block is never changed, a new one is
+ * interned instead, see env_shared_set().
+ */
+typedef struct _env_block {
+	struct _env_block	*next;	/* hash chain */
+	unsigned	hash;
+	int		refs;
+	size_t		count;		/* of variables */
+	char		*vars[];	/* followed by the strings */
+} env_block;
+
+#define ENV_BLOCK(envp)	((env_block *) (void *) ((char *) (envp) - \
+				offsetof(env_block, vars)))
+
+static env_block **env_table;
+static size_t env_buckets, env_blocks;
+DEFINE_LOCK(env_lock);
+
+static int same_vars(const env_block *b, const char *const *vars,
+	size_t count) {
+	size_t i;
+
+	if (b->count != count)
+		return (FALSE);
+	for (i = 0; i < count; i++)
+		if (strcmp(b->vars[i], vars[i]) != 0)
+			return (FALSE);
+	return (TRUE);
+}
+
+/* double the buckets of env_table; it is just slower if that fails */
+static void grow_env_table(void) {
+	size_t size = env_buckets ? env_buckets * 2 : 64, i;
+	env_block **table, *b, *next;
+
+	if ((table = calloc(size, sizeof (*table))) == NULL)
+		return;
+	for (i = 0; i < env_buckets; i++)
+		for (b = env_table[i]; b != NULL; b = next) {
+			next = b->next;
+			b->next = table[b->hash % size];
+			table[b->hash % size] = b;
+		}
+	free(env_table);
+	env_table = table;
+	env_buckets = size;
+}
+
+/*
+ * Return the shared block of the NULL terminated vars, with one more
+ * reference, or NULL if out of memory.
+ */
+char **env_intern(const char *const *vars) {
+	unsigned h = 2166136261u;
+	size_t count, len = 0, i;
+	const char *s;
+	env_block *b;
+	char *p;
+
+	for (count = 0; vars[count] != NULL; count++) {
+		for (s = vars[count]; *s; s++)
+			h = (h ^ (unsigned char) *s) * 16777619u;
+		h = (h ^ '\n') * 16777619u;
+		len += strlen(vars[count]) + 1;
+	}
+
+	LOCK(&env_lock);
+	if (env_buckets != 0)
+		for (b = env_table[h % env_buckets]; b != NULL; b = b->next)
+			if (b->hash == h && same_vars(b, vars, count)) {
+				b->refs++;
+				UNLOCK(&env_lock);
+				return (b->vars);
+			}
+
+	if (env_blocks >= env_buckets)
+		grow_env_table();
+	if (env_buckets == 0 || (b = malloc(sizeof (*b) +
+				(count + 1) * sizeof (char *) + len)) == NULL) {
+		UNLOCK(&env_lock);
+		return (NULL);
+	}
+	b->hash = h;
+	b->refs = 1;
+	b->count = count;
+	p = (char *) &b->vars[count + 1];
+	for (i = 0; i < count; i++) {
+		len = strlen(vars[i]) + 1;
+		b->vars[i] = memcpy(p, vars[i], len);
+		p += len;
+	}
+	b->vars[count] = NULL;
+	b->next = env_table[h % env_buckets];
+	env_table[h % env_buckets] = b;
+	env_blocks++;
+	UNLOCK(&env_lock);
+	return (b->vars);
+}
+
+/* drop a reference to the shared block envp */
+void env_release(char **envp) {
+	env_block *b, **bp;
+
+	if (envp == NULL)
+		return;
+	b = ENV_BLOCK(envp);
+	LOCK(&env_lock);
+	if (--b->refs == 0) {
+		for (bp = &env_table[b->hash % env_buckets]; *bp != b;
+			bp = &(*bp)->next) ;
+		*bp = b->next;
+		env_blocks--;
+		free(b);
+	}
+	UNLOCK(&env_lock);
+}
+
+/*
+ * Set envstr in vars, an array of *countp variables with room for one
+ * more, replacing the variable of the same name if there is one.
+ */
+void env_put(const char **vars, size_t *countp, const char *envstr) {
+	size_t i;
+
+	for (i = 0; i < *countp; i++)
+		if (!strcmp_until(vars[i], envstr, '=')) {
+			vars[i] = envstr;
+			return;
+		}
+	vars[(*countp)++] = envstr;
+}
+
+/*
+ * Return the shared block of envp, itself shared, with envstr set, and
+ * release envp; or NULL, keeping envp, if out of memory.
+ */
+char **env_shared_set(char **envp, const char *envstr) {
+	size_t count = ENV_BLOCK(envp)->count;
+	const char **vars;
+	char **newenvp;
+
+	if ((vars = malloc((count + 2) * sizeof (*vars))) == NULL)
+		return (NULL);
+	memcpy(vars, envp, count * sizeof (*vars));
+	env_put(vars, &count, envstr);
+	vars[count] = NULL;
+	newenvp = env_intern(vars);
+	free(vars);
+	if (newenvp != NULL)
+		env_release(envp);
+	return (newenvp);
+}
+
 /* The following states are used by load_env(), traversed in order: */
 enum env_state {
 	NAMEI,	/* First char of NAME, may be quote */
@@ -179,13 +336,13 @@ enum env_state {
  *		FALSE = not an env setting (file was repositioned)
  *		TRUE = was an env setting
  */
-int load_env(char *envstr, FILE * f) {
-	long filepos;
+int load_env(char *envstr, cron_buf * f) {
+	const char *filepos;
 	int fileline;
 	enum env_state state;
 	char quotechar, *c, *str, *val;
 
-	filepos = ftell(f);
+	filepos = f->p;
 	fileline = LineNumber;
 	if (EOF == get_string(envstr, MAX_ENVSTR, f, "\n"))
 		return (ERR);
@@ -261,9 +418,7 @@ int load_env(char *envstr, FILE * f) {
 	}
 	if (state != FINI && state != EQ2 && !(state == VALUE && !quotechar)) {
 		Debug(DPARS, ("load_env, not an env var, state = %d\n", state));
-		if (fseek(f, filepos, SEEK_SET)) {
-			return ERR;
-		}
+		f->p = filepos;
 		Set_LineNum(fileline);
 		return (FALSE);
 	}
@@ -289,6 +444,7 @@ char *env_get(const char *name, char **envp) {
 	return (NULL);
 }
 
+/* set HOME in envp, a shared block, if it has none */
 char **env_update_home(char **envp, const char *dir) {
 	char envstr[MAX_ENVSTR];
 
@@ -297,7 +453,7 @@ char **env_update_home(char **envp, const char *dir) {
 	}
 
 	if (glue_strings(envstr, sizeof envstr, "HOME", dir, '=')) {
-		envp = env_set(envp, envstr);
+		envp = env_shared_set(envp, envstr);
 	}			
 	else
 		log_it("CRON", getpid(), "ERROR", "can't set HOME", 0);
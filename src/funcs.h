@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #ifdef WITH_SELINUX
 #include <selinux/selinux.h>
@@ -46,33 +47,74 @@ void		set_cron_uid(void),
 		unlink_user(cron_db *, user *),
 		free_user(user *),
 		env_free(char **),
-		unget_char(int, FILE *),
+		env_release(char **),
+		pw_release(struct passwd *),
+		env_put(const char **, size_t *, const char *),
 		free_entry(entry *),
 		acquire_daemonlock(int),
 		log_it(const char *, PID_T, const char *, const char *, int),
 		log_close(void),
-		check_orphans(cron_db *);
+		check_orphans(cron_db *),
+		begin_user_lookups(void),
+		end_user_lookups(void),
+		free_user_lookup(void),
+		sched_add(entry *, user *),
+		sched_remove(entry *),
+		sched_seconds_reset(void),
+		watch_child(pid_t),
+		pwcache_prefetch(const char *),
+		cache_begin(void),
+		cache_end(cron_db *),
+		cache_record(user *, const char *, const entry *),
+		cache_rekey(user *, int),
+		cache_free(user *),
+		sched_visit(int, void (*)(entry *, user *)),
+		uring_open(uring_file **, int),
+		uring_stat(uring_file **, int),
+		uring_read(uring_file **, int),
+		unblock_signals(void);
 #if defined WITH_INOTIFY
 void 		set_cron_watched(int ),
 		set_cron_unwatched(int ),
-		check_inotify_database(cron_db *);
+		check_inotify_database(cron_db *, int);
+int		cron_watches_missing(void);
+const char	*cron_watched_path(int);
+time_t		inotify_reload_time(void);
 #endif
 
 int		load_database(cron_db *),
 		job_runqueue(void),
 		set_debug_flags(const char *),
-		get_char(FILE *),
-		get_string(char *, int, FILE *, const char *),
+		read_buf(int, cron_buf *),
+		get_string(char *, int, cron_buf *, const char *),
 		swap_uids(void),
 		swap_uids_back(void),
-		load_env(char *, FILE *),
+		load_env(char *, cron_buf *),
 		env_set_from_environ(char ***envpp),
 		cron_pabort(FILE *),
 		cron_pclose(FILE *),
 		glue_strings(char *, size_t, const char *, const char *, char),
 		strcmp_until(const char *, const char *, char),
-		skip_comments(FILE *),
-		allowed(const char * ,const char * ,const char *);
+		skip_comments(cron_buf *),
+		allowed(const char * ,const char * ,const char *),
+		sched_claim(int),
+		sched_due(int, long),
+		sched_next(int),
+		sched_scan(int, long, int),
+		sched_scan_next(entry **, user **),
+		sched_seconds_add(entry *, user *),
+		sched_seconds_next(void),
+		sched_seconds_due(int, entry **, user **),
+		pwcache_get(const char *, struct passwd **),
+		cache_fresh(const char *, const struct stat *),
+		cache_load(user *, const struct stat *, const cron_buf *,
+			struct passwd *, char ***),
+		cached_entry(entry *, const char *, struct passwd *, char **),
+		same_crontab(int, const user *),
+		same_entry(const entry *, const entry *),
+		pw_same(const struct passwd *, const struct passwd *);
+
+uint64_t	hash_buf(const cron_buf *);
 
 size_t		strlens(const char *, ...),
 		strdtb(char *);
@@ -84,16 +126,26 @@ char		*env_get(const char *, char **),
 		**env_init(void),
 		**env_copy(char **),
 		**env_set(char **, const char *),
-		**env_update_home(char **, const char *);
+		**env_update_home(char **, const char *),
+		**env_intern(const char *const *),
+		**env_shared_set(char **, const char *);
 
 user		*load_user(int, struct passwd *, const char *, const char *, const char *),
+		*load_user_read(int, const struct stat *, cron_buf *, struct passwd *,
+			const char *, const char *, const char *),
 		*find_user(cron_db *, const char *, const char *);
 
-entry		*load_entry(FILE *, void (*)(const char *), struct passwd *, char **);
+entry		*load_entry(cron_buf *, void (*)(const char *), struct passwd *, char **);
+
+cron_zone	*intern_zone(const char *);
+
+struct tm	*zone_time(cron_zone *, time_t);
 
 FILE		*cron_popen(char *, const char *, struct passwd *, char **);
 
-struct passwd	*pw_dup(const struct passwd *);
+struct passwd	*pw_dup(const struct passwd *),
+		*pw_share(const struct passwd *),
+		*lookup_user(const char *);
 
 #ifndef HAVE_STRUCT_TM_TM_GMTOFF
 long		get_gmtoff(time_t *, struct tm *);
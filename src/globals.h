@@ -72,7 +72,7 @@ XTRN const char *DowNames[]
 	;
 
 XTRN char	*ProgramName;
-XTRN int	LineNumber;
+XTRN THREAD_LOCAL int	LineNumber;
 XTRN int	SyslogOutput;
 XTRN time_t	StartTime;
 XTRN int	NoFork;
@@ -82,6 +82,8 @@ XTRN char       cron_default_mail_charset[MAX_ENVSTR];
 XTRN int        EnableClustering;
 XTRN int	ChangePath;
 XTRN double	RandomScale;
+XTRN int	ReloadDelay INIT(2);	/* seconds for changes to settle */
+XTRN int	FullScanInterval INIT(3600);	/* seconds, without inotify */
  
 #if DEBUGGING
 XTRN int	DebugFlags INIT(0);
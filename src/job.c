@@ -38,38 +38,50 @@ typedef struct _job {
 } job;
 
 static job *jhead = NULL, *jtail = NULL;
+static job *jfree = NULL;	/* nodes to reuse */
+
+	/* entries queued in this round have e->queued == jround */
+static unsigned jround = 1;
 
 void job_add(entry * e, user * u) {
 	job *j;
 	struct passwd *newpwd;
 	struct passwd *temppwd;
 	const char *uname;
+	int found;
 
 	/* if already on queue, keep going */
-	for (j = jhead; j != NULL; j = j->next)
-		if (j->e == e && j->u == u)
-			return;
+	if (e->queued == jround)
+		return;
 
 	uname = e->pwd->pw_name;
 	/* check if user exists in time of job is being run f.e. ldap */
-	if ((temppwd = getpwnam(uname)) != NULL) {
+	if ((found = pwcache_get(uname, &temppwd)) == TRUE) {
 		char **tenvp;
 
 		Debug(DSCH | DEXT, ("user [%s:%ld:%ld:...] cmd=\"%s\"\n",
 				e->pwd->pw_name, (long) temppwd->pw_uid,
 				(long) temppwd->pw_gid, e->cmd));
-		if ((newpwd = pw_dup(temppwd)) == NULL) {
-			log_it(uname, getpid(), "ERROR", "memory allocation failed", errno);
-			return;
+		/* the account changed, move to its current copy */
+		if (!pw_same(e->pwd, temppwd)) {
+			if ((newpwd = pw_share(temppwd)) == NULL) {
+				log_it(uname, getpid(), "ERROR", "memory allocation failed",
+					errno);
+				return;
+			}
+			pw_release(e->pwd);
+			e->pwd = newpwd;
+			uname = e->pwd->pw_name;	/* was in the old copy */
 		}
-		free(e->pwd);
-		e->pwd = newpwd;
 
 		if ((tenvp = env_update_home(e->envp, e->pwd->pw_dir)) == NULL) {
 			log_it(uname, getpid(), "ERROR", "memory allocation failed", errno);
 			return;
 		}
 		e->envp = tenvp;
+	} else if (found == ERR) {
+		log_it(uname, getpid(), "ERROR", "user lookup not answered", 0);
+		return;
 	} else {
 		log_it(uname, getpid(), "ERROR", "getpwnam() failed - user unknown",errno);
 		Debug(DSCH | DEXT, ("%s:%d pid=%d time=%lld getpwnam(%s) failed errno=%d error=%s\n",
@@ -78,8 +90,11 @@ void job_add(entry * e, user * u) {
 	}
 
 	/* build a job queue element */
-	if ((j = (job *) malloc(sizeof (job))) == NULL)
+	if ((j = jfree) != NULL)
+		jfree = j->next;
+	else if ((j = (job *) malloc(sizeof (job))) == NULL)
 		return;
+	e->queued = jround;
 	j->next = NULL;
 	j->e = e;
 	j->u = u;
@@ -99,9 +114,12 @@ int job_runqueue(void) {
 	for (j = jhead; j; j = jn) {
 		do_command(j->e, j->u);
 		jn = j->next;
-		free(j);
+		j->next = jfree;
+		jfree = j;
 		run++;
 	}
 	jhead = jtail = NULL;
+	if (++jround == 0)
+		jround = 1;
 	return (run);
 }
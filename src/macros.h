@@ -80,6 +80,14 @@
 #define MAXHOSTNAMELEN 64
 #endif
 
+	/* like getc() and ungetc() on a cron_buf, keeping LineNumber */
+#define	get_char(b)	((b)->p < (b)->end ? \
+			 (*(b)->p == '\n' ? LineNumber++ : 0, \
+			  (int) (unsigned char) *(b)->p++) : EOF)
+#define	unget_char(c, b) \
+			((void) ((c) != EOF ? \
+			 ((b)->p--, (c) == '\n' ? LineNumber-- : 0) : 0))
+
 #define	Skip_Blanks(c, f) \
 			while (c == '\t' || c == ' ') \
 				c = get_char(f);
@@ -97,6 +105,22 @@
 			()
 #endif /* DEBUGGING */
 
+	/* state of the crontab parser, which runs on several threads in
+	 * crond, see load_dir()
+	 */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#define	THREAD_LOCAL	__thread
+#define	DEFINE_LOCK(m)	static pthread_mutex_t m = PTHREAD_MUTEX_INITIALIZER
+#define	LOCK(m)		pthread_mutex_lock(m)
+#define	UNLOCK(m)	pthread_mutex_unlock(m)
+#else
+#define	THREAD_LOCAL
+#define	DEFINE_LOCK(m)	static int m
+#define	LOCK(m)		((void) (m))
+#define	UNLOCK(m)	((void) (m))
+#endif
+
 #define	MkUpper(ch)	(islower(ch) ? toupper(ch) : ch)
 #define	Set_LineNum(ln)	{Debug(DPARS|DEXT,("linenum=%d\n",ln)); \
 			 LineNumber = ln; \
@@ -109,6 +133,10 @@
 #define	SECONDS_PER_MINUTE	60
 #define	SECONDS_PER_HOUR	3600
 
+#define	FIRST_SECOND	0
+#define	LAST_SECOND	59
+#define	SECOND_COUNT	(LAST_SECOND - FIRST_SECOND + 1)
+
 #define	FIRST_MINUTE	0
 #define	LAST_MINUTE	59
 #define	MINUTE_COUNT	(LAST_MINUTE - FIRST_MINUTE + 1)
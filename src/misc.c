@@ -29,6 +29,7 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <pwd.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -372,92 +373,143 @@ void acquire_daemonlock(int closeflag) {
 	 */
 }
 
-/* get_char(file) : like getc() but increment LineNumber on newlines
+/* read_buf(fd, buf) : read the rest of the file open as fd into buf,
+ *	whose data the caller frees.  Returns OK, or ERR with errno set
+ *	and no data.
  */
-int get_char(FILE * file) {
-	int ch;
-
-	ch = getc(file);
-	if (ch == '\n')
-		Set_LineNum(LineNumber + 1)
-	return (ch);
+int read_buf(int fd, cron_buf * buf) {
+	struct stat statbuf;
+	size_t size = 4096, len = 0;
+	ssize_t n;
+	char *data, *newdata;
+	int save_errno;
+
+	buf->data = NULL;
+	buf->p = buf->end = NULL;
+
+	/* a regular file is read in one go, the extra byte sees the end */
+	if (fstat(fd, &statbuf) == 0 && S_ISREG(statbuf.st_mode) &&
+		statbuf.st_size > 0)
+		size = (size_t) statbuf.st_size + 1;
+	if ((data = malloc(size + 1)) == NULL)
+		return (ERR);
+
+	for (;;) {
+		if (len == size) {
+			if ((newdata = realloc(data, size * 2 + 1)) == NULL)
+				goto fail;
+			data = newdata;
+			size *= 2;
+		}
+		if ((n = read(fd, data + len, size - len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			goto fail;
+		}
+		if (n == 0)
+			break;
+		len += (size_t) n;
+	}
+	data[len] = '\0';
+	buf->data = data;
+	buf->p = data;
+	buf->end = data + len;
+	return (OK);
+
+  fail:
+	save_errno = errno;
+	free(data);
+	errno = save_errno;
+	return (ERR);
 }
 
-/* unget_char(ch, file) : like ungetc but do LineNumber processing
+/*
+ * Hash the contents of buf (64-bit FNV-1a), to tell whether a crontab
+ * changed.
  */
-void unget_char(int ch, FILE * file) {
-	ungetc(ch, file);
-	if (ch == '\n')
-		Set_LineNum(LineNumber - 1)
+uint64_t hash_buf(const cron_buf * buf) {
+	const unsigned char *p = (const unsigned char *) buf->data;
+	const unsigned char *end = (const unsigned char *) buf->end;
+	uint64_t h = 14695981039346656037u;
+
+	while (p < end)
+		h = (h ^ *p++) * 1099511628211u;
+	return (h);
+}
+
+/* count the newlines from s to end into LineNumber */
+static void count_lines(const char *s, const char *end) {
+	while (s < end && (s = memchr(s, '\n', (size_t) (end - s))) != NULL) {
+		LineNumber++;
+		s++;
+	}
 }
 
-/* get_string(str, max, file, termstr) : like fgets() but
+/* get_string(str, max, buf, termstr) : like fgets() but
  *      (1) has terminator string which should include \n
  *      (2) will always leave room for the null
- *      (3) uses get_char() so LineNumber will be accurate
+ *      (3) keeps LineNumber accurate
  *      (4) returns EOF or terminating character, whichever
+ *	A NUL in the file terminates the string as well.
  */
-int get_string(char *string, int size, FILE * file, const char *terms) {
-	int ch;
+int get_string(char *string, int size, cron_buf * buf, const char *terms) {
+	const char *s = buf->p;
+	size_t len;
 
-	while (EOF != (ch = get_char(file)) && !strchr(terms, ch)) {
-		if (size > 1) {
-			*string++ = (char) ch;
-			size--;
-		}
-	}
-
-	if (size > 0)
-		*string = '\0';
+	/* the data is followed by a NUL, so this stops at the end */
+	len = strcspn(s, terms);
+	if (size > 0) {
+		size_t n = len < (size_t) size ? len : (size_t) size - 1;
 
-	return (ch);
+		memcpy(string, s, n);
+		string[n] = '\0';
+	}
+	count_lines(s, s + len);
+	buf->p = s + len;
+	return (get_char(buf));
 }
 
-/* skip_comments(file) : read past comment (if any)
+/* skip_comments(buf) : read past comment (if any)
  */
-int skip_comments(FILE * file) {
-	int ch;
-	int n = 0;
+int skip_comments(cron_buf * buf) {
+	const char *start = buf->p, *s = buf->p, *t;
 
-	while (EOF != (ch = get_char(file))) {
-		/* ch is now the first character of a line.
+	while (s < buf->end) {
+		/* s is now the first character of a line.
 		 */
-		if (++n > MAX_GARBAGE)
-			return FALSE;
-		while (ch == ' ' || ch == '\t') {
-			ch = get_char(file);
-			if (++n > MAX_GARBAGE)
-				return FALSE;
-		}
+		for (t = s; t < buf->end && (*t == ' ' || *t == '\t'); t++)
+			;
 
-		if (ch == EOF)
-			break;
-
-		/* ch is now the first non-blank character of a line.
+		/* t is now the first non-blank character of a line,
+		 * which ends the comments unless it starts one or the
+		 * line is empty.
 		 */
-
-		if (ch != '\n' && ch != '#')
+		if (t < buf->end && *t != '\n' && *t != '#') {
+			s = t;
 			break;
-
-		/* ch must be a newline or comment as first non-blank
-		 * character on a line.
-		 */
-
-		while (ch != '\n' && ch != EOF) {
-			ch = get_char(file);
-			if (++n > MAX_GARBAGE)
-				return FALSE;
 		}
-		/* ch is now the newline of a line which we're going to
-		 * ignore.
-		 */
+		if (t == buf->end ||
+			(t = memchr(t, '\n', (size_t) (buf->end - t))) == NULL) {
+			s = buf->end;
+			break;
+		}
+		s = t + 1;
 	}
-	if (ch != EOF)
-		unget_char(ch, file);
+
+	if (s - start >= MAX_GARBAGE) {
+		s = start + MAX_GARBAGE;
+		count_lines(start, s);
+		buf->p = s;
+		return FALSE;
+	}
+	count_lines(start, s);
+	buf->p = s;
 	return TRUE;
 }
 
-void log_it(const char *username, PID_T xpid, const char *event,
+DEFINE_LOCK(log_lock);
+
+static void write_log(const char *username, PID_T xpid, const char *event,
 	const char *detail, int err) {
 #if defined(LOG_FILE) || DEBUGGING
 	PID_T pid = xpid;
@@ -539,6 +591,14 @@ void log_it(const char *username, PID_T xpid, const char *event,
 #endif
 }
 
+/* crontabs are parsed on several threads, see load_dir() */
+void log_it(const char *username, PID_T xpid, const char *event,
+	const char *detail, int err) {
+	LOCK(&log_lock);
+	write_log(username, xpid, event, detail, err);
+	UNLOCK(&log_lock);
+}
+
 void log_close(void) {
 	if (LogFD != ERR) {
 		close(LogFD);
@@ -720,3 +780,178 @@ long get_gmtoff(time_t * clock, struct tm *local) {
 	return (offset);
 }
 #endif /* HAVE_STRUCT_TM_TM_GMTOFF */
+
+/*
+ * Users are looked up one by one with getpwnam(), which is one NSS
+ * round trip each.  Between begin_user_lookups() and end_user_lookups(),
+ * as around a reload of the database, all users are read at once with
+ * getpwent() when more than PW_MAP_MIN are looked up, and then found in
+ * that map.  Names not in it, as with a backend which does not enumerate
+ * its users, are still looked up with getpwnam().
+ */
+#define PW_MAP_MIN	32
+
+typedef struct _pw_mapped {
+	struct _pw_mapped	*next;
+	struct passwd	*pw;
+} pw_mapped;
+
+static pw_mapped **pw_map;	/* hash of the users read, or NULL */
+static size_t pw_map_size;
+static int pw_lookups = -1;	/* -1 outside begin/end_user_lookups() */
+DEFINE_LOCK(pw_lock);
+
+	/* result of lookup_user() for a name not in the map, in a buffer
+	 * grown as long as getpwnam_r() finds it too small
+	 */
+#define PW_BUFSIZE	16384		/* if sysconf() does not tell */
+#define PW_BUFMAX	(1024 * 1024)
+static THREAD_LOCAL struct passwd pw_found;
+static THREAD_LOCAL char *pw_buf;
+static THREAD_LOCAL size_t pw_buf_size;
+
+static size_t hash_user(const char *name) {
+	size_t h = 5381;
+
+	while (*name)
+		h = h * 33 + (unsigned char) *name++;
+	return (h);
+}
+
+static void free_user_map(void) {
+	pw_mapped *m, *next;
+	size_t i;
+
+	for (i = 0; pw_map != NULL && i < pw_map_size; i++)
+		for (m = pw_map[i]; m != NULL; m = next) {
+			next = m->next;
+			free(m->pw);
+			free(m);
+		}
+	free(pw_map);
+	pw_map = NULL;
+	pw_map_size = 0;
+}
+
+static int fill_user_map(void) {
+	pw_mapped *list = NULL, *m, *next, **bp;
+	struct passwd *pw;
+	size_t n = 0, size = 64;
+	int ok = TRUE;
+
+	setpwent();
+	while (ok && (pw = getpwent()) != NULL) {
+		if ((m = malloc(sizeof (*m))) == NULL ||
+			(m->pw = pw_dup(pw)) == NULL) {
+			free(m);
+			ok = FALSE;
+			break;
+		}
+		m->next = list;
+		list = m;
+		n++;
+	}
+	endpwent();
+
+	while (size < n)
+		size *= 2;
+	if (ok && (pw_map = calloc(size, sizeof (*pw_map))) == NULL)
+		ok = FALSE;
+	pw_map_size = size;
+
+	/* the list is in reverse, so the first entry of a name ends up
+	 * in front, where getpwnam() would find it
+	 */
+	for (m = list; m != NULL; m = next) {
+		next = m->next;
+		if (!ok) {
+			free(m->pw);
+			free(m);
+			continue;
+		}
+		bp = &pw_map[hash_user(m->pw->pw_name) % size];
+		m->next = *bp;
+		*bp = m;
+	}
+	if (!ok) {
+		pw_map_size = 0;
+		return (FALSE);
+	}
+	Debug(DLOAD, ("[%ld] read %ld users\n", (long) getpid(), (long) n));
+	return (TRUE);
+}
+
+void begin_user_lookups(void) {
+	pw_lookups = 0;
+}
+
+void end_user_lookups(void) {
+	free_user_map();
+	pw_lookups = -1;
+}
+
+static int grow_pw_buf(void) {
+	size_t size;
+	long max;
+	char *buf;
+
+	if (pw_buf == NULL)
+		size = (max = sysconf(_SC_GETPW_R_SIZE_MAX)) > 0 ?
+			(size_t) max : PW_BUFSIZE;
+	else if ((size = 2 * pw_buf_size) > PW_BUFMAX)
+		return (FALSE);
+	if ((buf = realloc(pw_buf, size)) == NULL)
+		return (FALSE);
+	pw_buf = buf;
+	pw_buf_size = size;
+	return (TRUE);
+}
+
+/* free the buffer of lookup_user() of a thread that is done */
+void free_user_lookup(void) {
+	free(pw_buf);
+	pw_buf = NULL;
+	pw_buf_size = 0;
+}
+
+/*
+ * Look up the user name.  Crontabs are parsed on several threads, so a
+ * name not in the map is looked up with getpwnam_r(); that entry is good
+ * until the next lookup of the same thread.  Return NULL with errno 0 if
+ * there is no such user, or with the error if the lookup failed.
+ */
+struct passwd *lookup_user(const char *name) {
+	struct passwd *pw = NULL;
+	pw_mapped *m;
+	int err;
+
+	LOCK(&pw_lock);
+	if (pw_lookups >= 0 && pw_map == NULL && ++pw_lookups == PW_MAP_MIN + 1) {
+		if (!fill_user_map())
+			log_it("CRON", getpid(), "ERROR", "can't read all users, "
+				"looking them up one by one", ENOMEM);
+	}
+	if (pw_map != NULL)
+		for (m = pw_map[hash_user(name) % pw_map_size]; m != NULL; m = m->next)
+			if (strcmp(m->pw->pw_name, name) == 0) {
+				pw = m->pw;
+				break;
+			}
+	UNLOCK(&pw_lock);
+	if (pw != NULL)
+		return (pw);
+
+	if (pw_buf == NULL && !grow_pw_buf())
+		err = ENOMEM;
+	else
+		while ((err = getpwnam_r(name, &pw_found, pw_buf, pw_buf_size,
+					&pw)) == ERANGE && grow_pw_buf()) ;
+	if (err != 0) {
+		log_it(name, getpid(), "ERROR", "can't look up user", err);
+		errno = err;
+		return (NULL);
+	}
+	if (pw == NULL)
+		errno = 0;
+	return (pw);
+}
@@ -48,6 +48,7 @@
 #define PIDFILE		"crond.pid"
 #define _PATH_CRON_PID	PIDDIR PIDFILE
 #define REBOOT_LOCK     PIDDIR "cron.reboot"
+#define CRON_CACHE	PIDDIR "crond.cache"	/* compiled crontabs */
 
 #ifndef _PATH_BSHELL
 # define _PATH_BSHELL "/bin/sh"
@@ -65,4 +66,12 @@
 # define _PATH_DEVNULL "/dev/null"
 #endif
 
+#ifndef _PATH_PASSWD
+# define _PATH_PASSWD "/etc/passwd"
+#endif
+
+#ifndef _PATH_GROUP
+# define _PATH_GROUP "/etc/group"
+#endif
+
 #endif /* _PATHNAMES_H_ */
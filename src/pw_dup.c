@@ -34,9 +34,8 @@
 
 #include <sys/param.h>
 
-#if !defined(OpenBSD) || OpenBSD < 200105
-
 #include <pwd.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -44,6 +43,8 @@
 #include "funcs.h"
 #include "globals.h"
 
+#if !defined(OpenBSD) || OpenBSD < 200105
+
 struct passwd *
 pw_dup(const struct passwd *pw) {
 	char		*cp;
@@ -126,3 +127,142 @@ pw_dup(const struct passwd *pw) {
 }
 
 #endif /* !OpenBSD || OpenBSD < 200105 */
+
+/*
+ * The entries of crontabs point to shared, reference counted copies of
+ * the passwd entries of their users, rather than each having its own.
+ * There is one current copy per user name, which pw_share() hands out
+ * while the entry is the same; when the account changes, a new copy
+ * becomes current and the entries move to it as they are refreshed.
+ * Shared copies are never changed, and have no password.
+ */
+
+typedef struct _pw_shared {
+	struct _pw_shared	*next;	/* hash chain of the current copies */
+	unsigned	hash;		/* of the name */
+	int		refs;
+	int		current;	/* in the hash table */
+	struct passwd	pw;		/* followed by the strings */
+} pw_shared;
+
+#define PW_SHARED(pw)	((pw_shared *) (void *) ((char *) (pw) - \
+				offsetof(pw_shared, pw)))
+
+#define PW_SHARED_BUCKETS	256
+
+static pw_shared *pw_table[PW_SHARED_BUCKETS];
+DEFINE_LOCK(pw_share_lock);
+
+static int same_field(const char *a, const char *b) {
+	return (a == b || (a != NULL && b != NULL && strcmp(a, b) == 0));
+}
+
+/* are a and b the same account, but for the password? */
+int pw_same(const struct passwd *a, const struct passwd *b) {
+	return (a == b || (a->pw_uid == b->pw_uid && a->pw_gid == b->pw_gid &&
+		same_field(a->pw_name, b->pw_name) &&
+#ifdef LOGIN_CAP
+		same_field(a->pw_class, b->pw_class) &&
+#endif
+		same_field(a->pw_gecos, b->pw_gecos) &&
+		same_field(a->pw_dir, b->pw_dir) &&
+		same_field(a->pw_shell, b->pw_shell)));
+}
+
+static char *put_field(char **cpp, const char *s) {
+	char *cp = *cpp;
+	size_t len;
+
+	if (s == NULL)
+		return (NULL);
+	len = strlen(s) + 1;
+	*cpp += len;
+	return (memcpy(cp, s, len));
+}
+
+/*
+ * Return the shared copy of pw with one more reference, or NULL if out
+ * of memory.
+ */
+struct passwd *pw_share(const struct passwd *pw) {
+	const char *name = pw->pw_name != NULL ? pw->pw_name : "";
+	unsigned h = 2166136261u;
+	pw_shared *s, **sp;
+	size_t total;
+	const char *p;
+	char *cp;
+
+	for (p = name; *p; p++)
+		h = (h ^ (unsigned char) *p) * 16777619u;
+
+	LOCK(&pw_share_lock);
+	for (sp = &pw_table[h % PW_SHARED_BUCKETS]; (s = *sp) != NULL;
+		sp = &s->next)
+		if (s->hash == h && strcmp(s->pw.pw_name, name) == 0)
+			break;
+	if (s != NULL && pw_same(&s->pw, pw)) {
+		s->refs++;
+		UNLOCK(&pw_share_lock);
+		return (&s->pw);
+	}
+
+	total = sizeof (*s) + strlen(name) + 2;
+#ifdef LOGIN_CAP
+	if (pw->pw_class)
+		total += strlen(pw->pw_class) + 1;
+#endif
+	if (pw->pw_gecos)
+		total += strlen(pw->pw_gecos) + 1;
+	if (pw->pw_dir)
+		total += strlen(pw->pw_dir) + 1;
+	if (pw->pw_shell)
+		total += strlen(pw->pw_shell) + 1;
+	if ((cp = malloc(total)) == NULL) {
+		UNLOCK(&pw_share_lock);
+		return (NULL);
+	}
+
+	/* the account changed, entries still holding the old copy keep it */
+	if (s != NULL) {
+		*sp = s->next;
+		s->current = FALSE;
+	}
+
+	s = (pw_shared *) (void *) cp;
+	cp += sizeof (*s);
+	s->pw = *pw;
+	s->pw.pw_name = put_field(&cp, name);
+	s->pw.pw_passwd = put_field(&cp, "");
+#ifdef LOGIN_CAP
+	s->pw.pw_class = put_field(&cp, pw->pw_class);
+#endif
+	s->pw.pw_gecos = put_field(&cp, pw->pw_gecos);
+	s->pw.pw_dir = put_field(&cp, pw->pw_dir);
+	s->pw.pw_shell = put_field(&cp, pw->pw_shell);
+	s->hash = h;
+	s->refs = 1;
+	s->current = TRUE;
+	s->next = pw_table[h % PW_SHARED_BUCKETS];
+	pw_table[h % PW_SHARED_BUCKETS] = s;
+	UNLOCK(&pw_share_lock);
+	return (&s->pw);
+}
+
+/* drop a reference to the shared copy pw */
+void pw_release(struct passwd *pw) {
+	pw_shared *s, **sp;
+
+	if (pw == NULL)
+		return;
+	s = PW_SHARED(pw);
+	LOCK(&pw_share_lock);
+	if (--s->refs == 0) {
+		if (s->current) {
+			for (sp = &pw_table[s->hash % PW_SHARED_BUCKETS]; *sp != s;
+				sp = &(*sp)->next) ;
+			*sp = s->next;
+		}
+		free(s);
+	}
+	UNLOCK(&pw_share_lock);
+}
@@ -0,0 +1,366 @@
+/*
+ * Cache of the passwd entries of the users whose jobs crond starts, so
+ * that starting a job does not wait for NSS (LDAP, SSSD, ...).
+ *
+ * The lookups are done by a helper process, which reads user names from
+ * a socket and answers each with the entry found, if any.  It is not a
+ * thread: crond forks for every job, and a fork while a thread holds a
+ * lock of NSS would leave the child stuck.
+ *
+ * Entries are good for PW_TTL seconds, unknown users for PW_NEG_TTL.
+ * After half that time they are looked up again in the background, and
+ * until the answer comes the old entry is used.  The jobs due soon have
+ * their users asked for in advance.  A job whose user has no entry, or
+ * only an expired one, waits for the answer, but crond itself never
+ * calls NSS: a helper that leaves a request unanswered for PW_TIMEOUT
+ * seconds is taken for stuck, killed and started again, and the job is
+ * not run, as when getpwnam() fails.
+ *
+ * The entries kept are the shared copies of pw_share(), so the crontab
+ * entries of a user take the one made when the account changed.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cronie_common.h"
+#include "funcs.h"
+#include "globals.h"
+
+#define PW_TTL		300	/* seconds an entry is good for */
+#define PW_NEG_TTL	60	/* same for an unknown user */
+#define PW_RESPAWN	60	/* seconds between helper starts */
+#define PW_TIMEOUT	5	/* seconds an answer may take */
+#define PW_BUCKETS	256
+#define PW_MSGLEN	4096
+
+typedef struct _pw_cached {
+	struct _pw_cached	*next;
+	char		*name;
+	struct passwd	*pw;		/* NULL if there is no such user */
+	time_t		fetched;	/* 0 if never answered */
+	time_t		asked;		/* when the pending request was sent */
+	int		pending;	/* asked the helper */
+} pw_cached;
+
+	/* an answer of the helper, followed by the name, gecos, home
+	 * directory and shell, each terminated by a NUL
+	 */
+typedef struct _pw_reply {
+	int	found;		/* -1 if the lookup could not be sent */
+	uid_t	uid;
+	gid_t	gid;
+} pw_reply;
+
+static pw_cached *buckets[PW_BUCKETS];
+static int helper_fd = -1;
+static pid_t helper_pid;
+static time_t helper_started;
+
+static unsigned hash_name(const char *name) {
+	unsigned h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (unsigned char) *name++) * 16777619u;
+	return (h);
+}
+
+static pw_cached *find_cached(const char *name, int create) {
+	pw_cached **bp = &buckets[hash_name(name) % PW_BUCKETS];
+	pw_cached *c;
+
+	for (c = *bp; c != NULL; c = c->next)
+		if (strcmp(c->name, name) == 0)
+			return (c);
+	if (!create || (c = calloc(1, sizeof (*c))) == NULL)
+		return (NULL);
+	if ((c->name = strdup(name)) == NULL) {
+		free(c);
+		return (NULL);
+	}
+	c->next = *bp;
+	*bp = c;
+	return (c);
+}
+
+static size_t put_string(char *buf, size_t len, size_t size, const char *s) {
+	size_t n = strlen(s) + 1;
+
+	if (len + n > size)
+		return (0);
+	memcpy(buf + len, s, n);
+	return (len + n);
+}
+
+static void helper_main(int fd) ATTRIBUTE_NORETURN;
+
+static void helper_main(int fd) {
+	char name[PW_MSGLEN], buf[PW_MSGLEN];
+	struct passwd *pw;
+	pw_reply r;
+	ssize_t n;
+	size_t len;
+
+	for (;;) {
+		if ((n = recv(fd, name, sizeof name - 1, 0)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			_exit(0);
+		name[n] = '\0';
+
+		memset(&r, 0, sizeof r);
+		if ((pw = getpwnam(name)) != NULL) {
+			r.found = 1;
+			r.uid = pw->pw_uid;
+			r.gid = pw->pw_gid;
+		}
+		len = sizeof r;
+		len = put_string(buf, len, sizeof buf, name);
+		if (pw != NULL && len > 0) {
+			size_t end = put_string(buf, len, sizeof buf, pw->pw_gecos ? pw->pw_gecos : "");
+
+			/* the gecos field is not needed, drop it if too long */
+			if (end == 0)
+				end = put_string(buf, len, sizeof buf, "");
+			end = put_string(buf, end, sizeof buf, pw->pw_dir ? pw->pw_dir : "");
+			len = put_string(buf, end, sizeof buf, pw->pw_shell ? pw->pw_shell : "");
+		}
+		if (len == 0) {
+			r.found = -1;
+			len = put_string(buf, sizeof r, sizeof buf, "");
+		}
+		memcpy(buf, &r, sizeof r);
+		if (send(fd, buf, len, MSG_NOSIGNAL) < 0 && errno != EINTR)
+			_exit(0);
+	}
+}
+
+static int start_helper(void) {
+	int sv[2];
+	pid_t pid;
+	time_t now = time(NULL);
+
+	if (helper_started != 0 && now - helper_started < PW_RESPAWN)
+		return (FALSE);
+	helper_started = now;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+		log_it("CRON", getpid(), "ERROR", "can't create passwd lookup socket",
+			errno);
+		return (FALSE);
+	}
+	switch (pid = fork()) {
+	case -1:
+		log_it("CRON", getpid(), "ERROR", "can't fork passwd lookup helper",
+			errno);
+		close(sv[0]);
+		close(sv[1]);
+		return (FALSE);
+	case 0:
+		close(sv[0]);
+		unblock_signals();
+		acquire_daemonlock(1);
+		signal(SIGHUP, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		signal(SIGURG, SIG_DFL);
+		signal(SIGIO, SIG_DFL);
+		helper_main(sv[1]);
+	default:
+		break;
+	}
+	close(sv[1]);
+	(void) fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+	helper_fd = sv[0];
+	helper_pid = pid;
+	watch_child(pid);
+	Debug(DSCH, ("[%ld] passwd lookup helper %ld started\n",
+			(long) getpid(), (long) pid));
+	return (TRUE);
+}
+
+static void stop_helper(void) {
+	pw_cached *c;
+	int i;
+
+	/* the helper exits when it sees the socket closed */
+	close(helper_fd);
+	helper_fd = -1;
+	for (i = 0; i < PW_BUCKETS; i++)
+		for (c = buckets[i]; c != NULL; c = c->next)
+			c->pending = FALSE;
+}
+
+/*
+ * The helper is stuck in NSS and would not see the socket closed.  The
+ * next ask() starts a new one, within PW_RESPAWN.
+ */
+static void kill_helper(void) {
+	log_it("CRON", getpid(), "ERROR", "passwd lookup helper not answering",
+		0);
+	(void) kill(helper_pid, SIGKILL);
+	stop_helper();
+}
+
+static void store(pw_cached *c, const struct passwd *pw) {
+	struct passwd *newpw = NULL;
+
+	if (pw != NULL && (newpw = pw_share(pw)) == NULL)
+		return;
+	pw_release(c->pw);
+	c->pw = newpw;
+	c->fetched = time(NULL);
+}
+
+static void take_reply(const char *buf, size_t len) {
+	const char *s[4], *p = buf + sizeof (pw_reply), *end = buf + len;
+	struct passwd pw;
+	pw_reply r;
+	pw_cached *c;
+	int i;
+
+	if (len <= sizeof r)
+		return;
+	memcpy(&r, buf, sizeof r);
+	for (i = 0; i < 4 && p < end; i++) {
+		const char *nul = memchr(p, '\0', (size_t) (end - p));
+
+		if (nul == NULL)
+			return;
+		s[i] = p;
+		p = nul + 1;
+	}
+	if (i == 0 || (c = find_cached(s[0], FALSE)) == NULL)
+		return;
+
+	c->pending = FALSE;
+	if (r.found < 0)
+		return;
+	if (r.found == 0) {
+		store(c, NULL);
+		return;
+	}
+	if (i < 4)
+		return;
+	memset(&pw, 0, sizeof pw);
+	pw.pw_name = (char *) s[0];
+	pw.pw_passwd = "";
+	pw.pw_uid = r.uid;
+	pw.pw_gid = r.gid;
+	pw.pw_gecos = (char *) s[1];
+	pw.pw_dir = (char *) s[2];
+	pw.pw_shell = (char *) s[3];
+	store(c, &pw);
+}
+
+static void receive(void) {
+	char buf[PW_MSGLEN];
+	ssize_t n;
+
+	while (helper_fd >= 0) {
+		n = recv(helper_fd, buf, sizeof buf, MSG_DONTWAIT);
+		if (n > 0)
+			take_reply(buf, (size_t) n);
+		else if (n < 0 && errno == EINTR)
+			continue;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			stop_helper();
+	}
+}
+
+/*
+ * Have the helper look up c.  Return FALSE if there is no helper.
+ */
+static int ask(pw_cached *c) {
+	if (c->pending) {
+		if (time(NULL) - c->asked < PW_TIMEOUT)
+			return (TRUE);
+		kill_helper();
+	}
+	if (helper_fd < 0 && !start_helper())
+		return (FALSE);
+	if (send(helper_fd, c->name, strlen(c->name), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+		/* a full socket is tried again later */
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return (TRUE);
+		stop_helper();
+		return (FALSE);
+	}
+	c->pending = TRUE;
+	c->asked = time(NULL);
+	return (TRUE);
+}
+
+/* wait for the answer to c, at most until its request times out */
+static void await(pw_cached *c) {
+	struct pollfd pfd;
+	time_t left;
+
+	while (c->pending && helper_fd >= 0) {
+		if ((left = c->asked + PW_TIMEOUT - time(NULL)) <= 0) {
+			kill_helper();
+			return;
+		}
+		pfd.fd = helper_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, (int) left * 1000) < 0 && errno != EINTR)
+			return;
+		receive();
+	}
+}
+
+static int ttl(const pw_cached *c) {
+	return (c->pw != NULL ? PW_TTL : PW_NEG_TTL);
+}
+
+static int needs_refresh(const pw_cached *c) {
+	return (c->fetched == 0 || time(NULL) - c->fetched >= ttl(c) / 2);
+}
+
+static int expired(const pw_cached *c) {
+	return (c->fetched == 0 || time(NULL) - c->fetched >= ttl(c));
+}
+
+/*
+ * Look up the user name.  Return TRUE and set *pwp if the user exists,
+ * FALSE if not, and ERR if there is no answer to be had now.
+ */
+int pwcache_get(const char *name, struct passwd **pwp) {
+	pw_cached *c;
+
+	receive();
+	*pwp = NULL;
+	if ((c = find_cached(name, TRUE)) == NULL)
+		return (ERR);
+
+	if (needs_refresh(c) && ask(c) && expired(c))
+		await(c);
+	if (expired(c))
+		return (ERR);
+	*pwp = c->pw;
+	return (c->pw != NULL);
+}
+
+/*
+ * Have the user name looked up in the background if it is not cached
+ * or getting old, as a job of the user is due soon.
+ */
+void pwcache_prefetch(const char *name) {
+	pw_cached *c;
+
+	receive();
+	if ((c = find_cached(name, TRUE)) != NULL && needs_refresh(c))
+		(void) ask(c);
+}
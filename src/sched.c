@@ -0,0 +1,838 @@
+/*
+ * Ordering of the loaded crontab entries by the virtual minute in which
+ * they run next, so that find_jobs() does not have to test every entry
+ * of the database every minute.
+ *
+ * The entries live in a binary min-heap keyed by their next run time.
+ * Each tick pops the entries that are due, hands them to find_jobs() for
+ * the usual checks and re-arms them for their following run.  They are
+ * handed over in the order of the database, not of the heap, so that
+ * the jobs of a minute start in the order of their crontabs, as they
+ * did when find_jobs() walked all entries.
+ *
+ * Entries with their own CRON_TZ depend on the offset of another
+ * timezone and are checked every minute.  They are kept apart in a
+ * table of their schedule bits, one array per field, matched all at
+ * once against the time of each (zone, RANDOM_DELAY) pair; only the
+ * entries which match are handed to find_jobs().
+ *
+ * Entries with a field of seconds are matched by the minute like all
+ * others.  Those due in the current minute are then kept in a list of
+ * their own, and the main loop wakes up for each of their seconds.
+ *
+ * Minutes revisited after a time change cannot be served by the heap.
+ * For those there is an index of the entries by the (hour, minute) in
+ * which they run, with a separate list of the wildcard entries that
+ * have to be checked every time.  The index is rebuilt from the heap
+ * on first use after the database changed; time changes are rare and
+ * the reloads need not pay for it.
+ *
+ * Virtual minutes are the ones used by the main loop in cron.c: minutes
+ * since the epoch, adjusted for the GMT offset of the local timezone.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "funcs.h"
+#include "globals.h"
+
+#define SCHED_UNARMED	INT_MIN	/* not armed yet, do it at next tick */
+#define SCHED_NEVER	INT_MAX	/* no matching time at all, f.e. 30 Feb */
+
+	/* how far to look for the next run; see the comment about the
+	 * largest interval between two crontab matches in cronnext.c
+	 */
+#define SCHED_HORIZON	((time_t)8 * 366 * 24 * SECONDS_PER_HOUR)
+
+#define SECONDS_PER_DAY	(24 * SECONDS_PER_HOUR)
+#define MINUTES_PER_DAY	(HOUR_COUNT * MINUTE_COUNT)
+
+typedef struct _sched_node {
+	int	when;		/* virtual minute of the next run */
+	entry	*e;
+	user	*u;
+} sched_node;
+
+typedef struct _sched_ref {
+	entry	*e;
+	user	*u;
+} sched_ref;
+
+	/* a (zone, RANDOM_DELAY) pair of the CRON_TZ table, with the
+	 * 0-based fields of the time being matched
+	 */
+typedef struct _sched_class {
+	cron_zone	*z;
+	int		delay;
+	int		minute, hour, dom, month, dow;
+} sched_class;
+
+static sched_node *heap;	/* 1-based, heap[0] is unused */
+static int heap_len, heap_size;
+static int sched_vtime = INT_MIN;	/* newest virtual minute claimed */
+static int sched_lost;		/* an entry could not be queued */
+
+	/* the (hour, minute) index: entries of slot s are slot_refs[i]
+	 * for slot_start[s] <= i < slot_start[s + 1], the wildcard and
+	 * CRON_TZ ones are star_refs[0 .. star_len - 1]
+	 */
+static sched_ref *slot_refs, *star_refs;
+static int slot_start[MINUTES_PER_DAY + 1];
+static int star_len;
+static int index_stale = TRUE;
+
+	/* the CRON_TZ entries; bit n of each mask is bit n of the
+	 * bitstring of the entry, row i belongs to ref[i]
+	 */
+static struct {
+	uint64_t	*minute;
+	uint32_t	*hour;
+	uint32_t	*dom;
+	uint16_t	*month;
+	uint16_t	*dow;
+	unsigned char	*orday;		/* dom or dow will do, see day_matches() */
+	int		*cls;		/* index into classes[] */
+	unsigned char	*hit;
+	sched_ref	*ref;
+	sched_ref	*hits;		/* refs of the rows that matched */
+	int		len, size;
+} zt;
+
+static sched_class *classes;
+static int nclasses;
+static int classes_stale;
+
+	/* entries with SEC_FIELD due in the current minute, the
+	 * union of their seconds, and the last second run
+	 */
+static struct {
+	sched_ref	*refs;
+	int		len, size, pos;
+	uint64_t	mask;
+	int		done;
+} secq = { NULL, 0, 0, 0, 0, -1 };
+
+	/* the entries which may run in the minute of find_jobs(), in the
+	 * order of the database; sched_scan_next() walks through them
+	 */
+static sched_ref *due;
+static int due_len, due_size, due_pos;
+
+static void heap_swap(int a, int b) {
+	sched_node tmp;
+
+	tmp = heap[a];
+	heap[a] = heap[b];
+	heap[b] = tmp;
+	heap[a].e->sched_idx = a;
+	heap[b].e->sched_idx = b;
+}
+
+static void sift_up(int i) {
+	while (i > 1 && heap[i / 2].when > heap[i].when) {
+		heap_swap(i, i / 2);
+		i /= 2;
+	}
+}
+
+static void sift_down(int i) {
+	int child;
+
+	while ((child = 2 * i) <= heap_len) {
+		if (child < heap_len && heap[child + 1].when < heap[child].when)
+			child++;
+		if (heap[i].when <= heap[child].when)
+			break;
+		heap_swap(i, child);
+		i = child;
+	}
+}
+
+static int days_in_month(const struct tm *tm) {
+	static const int mdays[] = {
+		31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+	};
+	int year = tm->tm_year + 1900;
+
+	if (tm->tm_mon == 1 &&
+		((year % 4 == 0 && year % 100 != 0) || year % 400 == 0))
+		return 29;
+	return mdays[tm->tm_mon];
+}
+
+/* the dom/dow rule, see the comment in find_jobs() in cron.c */
+static int day_matches(const entry *e, const struct tm *tm) {
+	int dom = tm->tm_mday - FIRST_DOM;
+	int dow = tm->tm_wday - FIRST_DOW;
+
+	if ((e->flags & DOM_STAR) || (e->flags & DOW_STAR))
+		return bit_test(e->dow, dow) && bit_test(e->dom, dom);
+	return bit_test(e->dow, dow) || bit_test(e->dom, dom);
+}
+
+/*
+ * Return the first virtual minute not before 'from' in which the entry
+ * runs.  find_jobs() matches an entry without CRON_TZ against the
+ * broken-down GMT time of its virtual minute less the RANDOM_DELAY, so
+ * this is plain calendar arithmetic with no DST involved.
+ */
+static int next_run(const entry *e, int from) {
+	struct tm tm;
+	time_t t, limit;
+	int hour, minute;
+
+	t = (time_t)(from - e->delay) * SECONDS_PER_MINUTE;
+	limit = t + SCHED_HORIZON;
+
+	while (t <= limit) {
+		gmtime_r(&t, &tm);
+
+		/* month doesn't match: move to the 1st of next month */
+		if (!bit_test(e->month, tm.tm_mon + 1 - FIRST_MONTH)) {
+			t += (time_t)(days_in_month(&tm) - tm.tm_mday + 1) *
+				SECONDS_PER_DAY - tm.tm_hour * SECONDS_PER_HOUR -
+				tm.tm_min * SECONDS_PER_MINUTE;
+			continue;
+		}
+
+		/* day doesn't match: move to the next midnight */
+		if (!day_matches(e, &tm)) {
+			t += SECONDS_PER_DAY - tm.tm_hour * SECONDS_PER_HOUR -
+				tm.tm_min * SECONDS_PER_MINUTE;
+			continue;
+		}
+
+		/* find the hour, or try the next day */
+		for (hour = tm.tm_hour; hour <= LAST_HOUR; hour++)
+			if (bit_test(e->hour, hour - FIRST_HOUR))
+				break;
+		if (hour > LAST_HOUR) {
+			t += SECONDS_PER_DAY - tm.tm_hour * SECONDS_PER_HOUR -
+				tm.tm_min * SECONDS_PER_MINUTE;
+			continue;
+		}
+		if (hour != tm.tm_hour) {
+			t += (hour - tm.tm_hour) * SECONDS_PER_HOUR -
+				tm.tm_min * SECONDS_PER_MINUTE;
+			tm.tm_min = 0;
+		}
+
+		/* find the minute, or try the next hour */
+		for (minute = tm.tm_min; minute <= LAST_MINUTE; minute++)
+			if (bit_test(e->minute, minute - FIRST_MINUTE))
+				break;
+		if (minute > LAST_MINUTE) {
+			t += SECONDS_PER_HOUR - tm.tm_min * SECONDS_PER_MINUTE;
+			continue;
+		}
+		t += (minute - tm.tm_min) * SECONDS_PER_MINUTE;
+
+		return (int)(t / SECONDS_PER_MINUTE) + e->delay;
+	}
+	return SCHED_NEVER;
+}
+
+static uint64_t bits_of(const bitstr_t *bits, int nbits) {
+	uint64_t mask = 0;
+	int i;
+
+	for (i = 0; i < nbits; i++)
+		if (bit_test(bits, i))
+			mask |= (uint64_t)1 << i;
+	return (mask);
+}
+
+static void *grow(void *array, int size, size_t elsize) {
+	return (realloc(array, (size_t)size * elsize));
+}
+
+#define GROW(a, size) do { \
+	void *p = grow((a), (size), sizeof (*(a))); \
+	if (p == NULL) \
+		return (FALSE); \
+	(a) = p; \
+	} while (0)
+
+static int zone_table_grow(void) {
+	int size = zt.size ? zt.size * 2 : 16;
+
+	GROW(zt.minute, size);
+	GROW(zt.hour, size);
+	GROW(zt.dom, size);
+	GROW(zt.month, size);
+	GROW(zt.dow, size);
+	GROW(zt.orday, size);
+	GROW(zt.cls, size);
+	GROW(zt.hit, size);
+	GROW(zt.ref, size);
+	GROW(zt.hits, size);
+	zt.size = size;
+	return (TRUE);
+}
+
+/* the rows of the table are -1, -2, ... in e->sched_idx */
+static int zone_table_add(entry *e, user *u) {
+	int i;
+
+	if (zt.len == zt.size && !zone_table_grow())
+		return (FALSE);
+
+	i = zt.len++;
+	zt.minute[i] = bits_of(e->minute, MINUTE_COUNT);
+	zt.hour[i] = (uint32_t)bits_of(e->hour, HOUR_COUNT);
+	zt.dom[i] = (uint32_t)bits_of(e->dom, DOM_COUNT);
+	zt.month[i] = (uint16_t)bits_of(e->month, MONTH_COUNT);
+	zt.dow[i] = (uint16_t)bits_of(e->dow, DOW_COUNT);
+	zt.orday[i] = !((e->flags & DOM_STAR) || (e->flags & DOW_STAR));
+	zt.ref[i].e = e;
+	zt.ref[i].u = u;
+	e->sched_idx = -(i + 1);
+	classes_stale = TRUE;
+	return (TRUE);
+}
+
+static void zone_table_remove(int i) {
+	int last = --zt.len;
+
+	classes_stale = TRUE;
+	if (i == last)
+		return;
+
+	zt.minute[i] = zt.minute[last];
+	zt.hour[i] = zt.hour[last];
+	zt.dom[i] = zt.dom[last];
+	zt.month[i] = zt.month[last];
+	zt.dow[i] = zt.dow[last];
+	zt.orday[i] = zt.orday[last];
+	zt.ref[i] = zt.ref[last];
+	zt.ref[i].e->sched_idx = -(i + 1);
+}
+
+static int build_classes(void) {
+	sched_class *c;
+	int i, k;
+
+	free(classes);
+	classes = NULL;
+	nclasses = 0;
+	if (zt.len > 0 &&
+		(classes = malloc((size_t)zt.len * sizeof (*classes))) == NULL)
+		return (FALSE);
+
+	for (i = 0; i < zt.len; i++) {
+		const entry *e = zt.ref[i].e;
+
+		for (k = 0; k < nclasses; k++)
+			if (classes[k].z == e->tz && classes[k].delay == e->delay)
+				break;
+		if (k == nclasses) {
+			c = &classes[nclasses++];
+			c->z = e->tz;
+			c->delay = e->delay;
+		}
+		zt.cls[i] = k;
+	}
+	classes_stale = FALSE;
+	return (TRUE);
+}
+
+/*
+ * Match all CRON_TZ entries against the virtual minute vtime and collect
+ * those which run in zt.hits.  The time is converted once per class, the
+ * loop over the rows has no branches and can be vectorized.
+ */
+static int match_zone_table(int vtime, long vGMToff) {
+	sched_class *c;
+	struct tm *tm;
+	int i, nhits;
+
+	if (classes_stale && !build_classes()) {
+		log_it("CRON", getpid(), "ERROR", "can't match CRON_TZ entries",
+			errno);
+		return (0);
+	}
+
+	for (c = classes; c < classes + nclasses; c++) {
+		time_t virtualSecond = (time_t)(vtime - c->delay) * SECONDS_PER_MINUTE;
+
+		/* as in find_job() */
+		if (c->z->name[0] != '\0')
+			tm = zone_time(c->z, virtualSecond - vGMToff);
+		else
+			tm = gmtime(&virtualSecond);
+		c->minute = tm->tm_min - FIRST_MINUTE;
+		c->hour = tm->tm_hour - FIRST_HOUR;
+		c->dom = tm->tm_mday - FIRST_DOM;
+		c->month = tm->tm_mon + 1 - FIRST_MONTH;
+		c->dow = tm->tm_wday - FIRST_DOW;
+	}
+
+	for (i = 0; i < zt.len; i++) {
+		const sched_class *k = &classes[zt.cls[i]];
+		uint32_t dom = zt.dom[i] >> k->dom;
+		uint32_t dow = (uint32_t)zt.dow[i] >> k->dow;
+
+		zt.hit[i] = (unsigned char)(1 &
+			(zt.minute[i] >> k->minute) &
+			(zt.hour[i] >> k->hour) &
+			((uint32_t)zt.month[i] >> k->month) &
+			((dom & dow) | ((dom | dow) & zt.orday[i])));
+	}
+
+	for (i = nhits = 0; i < zt.len; i++)
+		if (zt.hit[i])
+			zt.hits[nhits++] = zt.ref[i];
+	return (nhits);
+}
+
+/*
+ * Return the broken-down time of t in the zone z.  Switching TZ means
+ * tzset() reloading the zone, so the result is kept in z for all the
+ * other entries of this zone in this minute.  TZ is left set, the
+ * caller has to restore it.
+ */
+struct tm *zone_time(cron_zone *z, time_t t) {
+	if (z->when != t) {
+		setenv("TZ", z->name, 1);
+		z->tm = *localtime(&t);
+		z->when = t;
+	}
+	return (&z->tm);
+}
+
+static void lose_entries(void) {
+	if (!sched_lost)
+		log_it("CRON", getpid(), "ERROR",
+			"can't queue entry, checking all entries every minute",
+			errno);
+	sched_lost = TRUE;
+}
+
+/*
+ * Queue a freshly loaded entry.  It is armed at the next tick, when we
+ * know which minute it is.
+ */
+void sched_add(entry *e, user *u) {
+	sched_node *n;
+
+	if (e->sched_idx != 0 || (e->flags & WHEN_REBOOT))
+		return;
+
+	if (e->tz != NULL) {
+		if (!zone_table_add(e, u))
+			lose_entries();
+		return;
+	}
+
+	if (heap_len + 1 >= heap_size) {
+		int size = heap_size ? heap_size * 2 : 64;
+
+		if ((n = realloc(heap, (size_t)size * sizeof (*n))) == NULL) {
+			lose_entries();
+			return;
+		}
+		heap = n;
+		heap_size = size;
+	}
+
+	index_stale = TRUE;
+	n = &heap[++heap_len];
+	n->when = SCHED_UNARMED;
+	n->e = e;
+	n->u = u;
+	e->sched_idx = heap_len;
+	sift_up(heap_len);
+}
+
+/*
+ * Take entry i out of the seconds queue.  The entries which
+ * sched_seconds_due() has not looked at yet stay after secq.pos.
+ */
+static void seconds_remove(int i) {
+	if (i < secq.pos) {
+		secq.refs[i] = secq.refs[--secq.pos];
+		i = secq.pos;
+	}
+	secq.refs[i] = secq.refs[--secq.len];
+}
+
+void sched_remove(entry *e) {
+	entry *moved;
+	int i;
+
+	if (e->flags & SEC_FIELD)
+		for (i = 0; i < secq.len; i++)
+			if (secq.refs[i].e == e) {
+				seconds_remove(i);
+				break;
+			}
+
+	i = e->sched_idx;
+	if (i == 0)
+		return;
+
+	e->sched_idx = 0;
+	if (i < 0) {
+		zone_table_remove(-i - 1);
+		return;
+	}
+
+	index_stale = TRUE;
+	if (i == heap_len--)
+		return;
+
+	/* fill the hole with the last node and restore the heap order */
+	heap[i] = heap[heap_len + 1];
+	moved = heap[i].e;
+	moved->sched_idx = i;
+	sift_up(i);
+	sift_down(moved->sched_idx);
+}
+
+/*
+ * Claim the virtual minute vtime for find_jobs().  Return TRUE if the
+ * heap can tell which entries are due then, i.e. vtime is newer than
+ * any minute seen before; minutes revisited after a time change need
+ * a full scan.
+ */
+int sched_claim(int vtime) {
+	int ready = !sched_lost && vtime > sched_vtime;
+
+	if (vtime > sched_vtime)
+		sched_vtime = vtime;
+	return (ready);
+}
+
+/*
+ * Pop the entries which may run in the virtual minute vtime into due[]
+ * and re-arm them for their next run.  Entries which missed their
+ * minute (because it was skipped, or served by a full scan) are
+ * re-armed silently.  due[] has room for the whole heap.
+ */
+static void pop_due(int vtime) {
+	sched_node *n;
+
+	while (heap_len > 0 && heap[1].when <= vtime) {
+		n = &heap[1];
+		if (n->when == vtime) {
+			due[due_len].e = n->e;
+			due[due_len].u = n->u;
+			due_len++;
+			n->when = next_run(n->e, vtime + 1);
+		}
+		else
+			n->when = next_run(n->e, vtime);
+		sift_down(1);
+	}
+}
+
+/* arm the entries which are not armed for from or later */
+static void arm_from(int from) {
+	sched_node *n;
+
+	while (heap_len > 0 && heap[1].when < from) {
+		n = &heap[1];
+		n->when = next_run(n->e, from);
+		sift_down(1);
+	}
+}
+
+/*
+ * Return the first virtual minute from from on in which an entry may
+ * run, or SCHED_NEVER if there is none.  The CRON_TZ entries are checked
+ * every minute, so with any of them, or with entries lost, that is from.
+ */
+int sched_next(int from) {
+	if (sched_lost || zt.len > 0)
+		return (from);
+
+	arm_from(from);
+	return (heap_len > 0 ? heap[1].when : SCHED_NEVER);
+}
+
+static void visit_heap(int i, int vtime, void (*fn)(entry *, user *)) {
+	if (i > heap_len || heap[i].when != vtime)
+		return;
+	fn(heap[i].e, heap[i].u);
+	visit_heap(2 * i, vtime, fn);
+	visit_heap(2 * i + 1, vtime, fn);
+}
+
+/*
+ * Call fn for each entry of the heap which runs in the virtual minute
+ * vtime.  The entries not armed for it yet are armed first, as the
+ * tick of vtime would do.  CRON_TZ entries are not visited: which of
+ * them run is known only in their minute.
+ */
+void sched_visit(int vtime, void (*fn)(entry *, user *)) {
+	arm_from(vtime);
+	visit_heap(1, vtime, fn);
+}
+
+static int is_star(const sched_node *n) {
+	return (n->e->flags & (MIN_STAR | HR_STAR)) != 0;
+}
+
+/*
+ * Call fn for each (hour, minute) slot of the day in which the entry
+ * runs.  The slots are shifted by the RANDOM_DELAY, like the virtual
+ * minutes find_jobs() is called with.
+ */
+static void for_each_slot(const entry *e, void (*fn)(int, const sched_node *),
+	const sched_node *n) {
+	int hour, minute;
+
+	for (hour = FIRST_HOUR; hour <= LAST_HOUR; hour++) {
+		if (!bit_test(e->hour, hour - FIRST_HOUR))
+			continue;
+		for (minute = FIRST_MINUTE; minute <= LAST_MINUTE; minute++)
+			if (bit_test(e->minute, minute - FIRST_MINUTE))
+				fn((hour * MINUTE_COUNT + minute + e->delay) %
+					MINUTES_PER_DAY, n);
+	}
+}
+
+static void count_slot(int slot, const sched_node *n) {
+	(void) n;
+	slot_start[slot + 1]++;
+}
+
+static void fill_slot(int slot, const sched_node *n) {
+	sched_ref *r = &slot_refs[slot_start[slot]++];
+
+	r->e = n->e;
+	r->u = n->u;
+}
+
+static int build_index(void) {
+	sched_node *n;
+	int i, slot, total;
+
+	free(slot_refs);
+	free(star_refs);
+	slot_refs = star_refs = NULL;
+	memset(slot_start, 0, sizeof (slot_start));
+	star_len = 0;
+
+	for (i = 1; i <= heap_len; i++) {
+		n = &heap[i];
+		if (is_star(n))
+			star_len++;
+		else
+			for_each_slot(n->e, count_slot, n);
+	}
+	for (slot = 0; slot < MINUTES_PER_DAY; slot++)
+		slot_start[slot + 1] += slot_start[slot];
+	total = slot_start[MINUTES_PER_DAY];
+
+	if ((total > 0 &&
+			(slot_refs = malloc((size_t)total * sizeof (*slot_refs))) == NULL) ||
+		(star_len > 0 &&
+			(star_refs = malloc((size_t)star_len * sizeof (*star_refs))) == NULL)) {
+		log_it("CRON", getpid(), "ERROR", "can't build schedule index", errno);
+		free(slot_refs);
+		slot_refs = NULL;
+		return (FALSE);
+	}
+
+	/* fill_slot() advances slot_start[s] to the end of the slot,
+	 * i.e. to the start of slot s + 1; shift it back afterwards
+	 */
+	star_len = 0;
+	for (i = 1; i <= heap_len; i++) {
+		n = &heap[i];
+		if (is_star(n)) {
+			star_refs[star_len].e = n->e;
+			star_refs[star_len].u = n->u;
+			star_len++;
+		}
+		else
+			for_each_slot(n->e, fill_slot, n);
+	}
+	for (slot = MINUTES_PER_DAY; slot > 0; slot--)
+		slot_start[slot] = slot_start[slot - 1];
+	slot_start[0] = 0;
+
+	Debug(DSCH, ("[%ld] schedule index: %d slot refs, %d star entries\n",
+			(long) getpid(), total, star_len));
+	index_stale = FALSE;
+	return (TRUE);
+}
+
+/* make room for len entries in due[] and empty it */
+static int due_reset(int len) {
+	sched_ref *r;
+	int size = due_size ? due_size : 64;
+
+	due_len = due_pos = 0;
+	if (len <= due_size)
+		return (TRUE);
+	while (size < len)
+		size *= 2;
+	if ((r = realloc(due, (size_t)size * sizeof (*r))) == NULL)
+		return (FALSE);
+	due = r;
+	due_size = size;
+	return (TRUE);
+}
+
+static void due_add(const sched_ref *refs, int len) {
+	memcpy(due + due_len, refs, (size_t)len * sizeof (*refs));
+	due_len += len;
+}
+
+/* the order in which find_jobs() used to walk the database */
+static int compare_due(const void *a, const void *b) {
+	const sched_ref *ra = a, *rb = b;
+
+	if (ra->u != rb->u)
+		return (ra->u->order < rb->u->order ? -1 : 1);
+	return (ra->e->order - rb->e->order);
+}
+
+static void due_sort(void) {
+	if (due_len > 1)
+		qsort(due, (size_t)due_len, sizeof (*due), compare_due);
+}
+
+/*
+ * Prepare sched_scan_next() to walk the entries which may run in the
+ * new virtual minute vtime: those the heap has due, and the CRON_TZ
+ * entries which match.  Return FALSE if out of memory; nothing is
+ * popped then and all entries have to be scanned.
+ */
+int sched_due(int vtime, long vGMToff) {
+	int nhits = match_zone_table(vtime, vGMToff);
+
+	if (!due_reset(heap_len + nhits))
+		return (FALSE);
+	pop_due(vtime);
+	due_add(zt.hits, nhits);
+	due_sort();
+	return (TRUE);
+}
+
+/*
+ * Prepare sched_scan_next() to walk the entries which may run in the
+ * revisited virtual minute vtime: the wildcard entries, the fixed-time
+ * entries of vtime's slot if doNonWild is set, and the CRON_TZ entries
+ * which match.  Return FALSE if there is no usable index, so all entries
+ * have to be scanned.
+ */
+int sched_scan(int vtime, long vGMToff, int doNonWild) {
+	int slot, nslot, nhits;
+
+	if (sched_lost || (index_stale && !build_index()))
+		return (FALSE);
+
+	slot = vtime % MINUTES_PER_DAY;
+	if (slot < 0)
+		slot += MINUTES_PER_DAY;
+	nslot = doNonWild ? slot_start[slot + 1] - slot_start[slot] : 0;
+
+	nhits = match_zone_table(vtime, vGMToff);
+	if (!due_reset(star_len + nslot + nhits))
+		return (FALSE);
+	due_add(star_refs, star_len);
+	due_add(slot_refs + slot_start[slot], nslot);
+	due_add(zt.hits, nhits);
+	due_sort();
+	return (TRUE);
+}
+
+int sched_scan_next(entry **ep, user **up) {
+	if (due_pos == due_len)
+		return (FALSE);
+
+	*ep = due[due_pos].e;
+	*up = due[due_pos].u;
+	due_pos++;
+	return (TRUE);
+}
+
+/*
+ * Start a new minute for the entries with a field of seconds.
+ */
+void sched_seconds_reset(void) {
+	secq.len = secq.pos = 0;
+	secq.mask = 0;
+	secq.done = -1;
+}
+
+/*
+ * Queue an entry with a field of seconds which is due in the current
+ * minute.  Return FALSE if out of memory.
+ */
+int sched_seconds_add(entry *e, user *u) {
+	sched_ref *r;
+	int i;
+
+	for (i = 0; i < secq.len; i++)
+		if (secq.refs[i].e == e && secq.refs[i].u == u)
+			return (TRUE);
+
+	if (secq.len == secq.size) {
+		int size = secq.size ? secq.size * 2 : 16;
+
+		if ((r = realloc(secq.refs, (size_t)size * sizeof (*r))) == NULL)
+			return (FALSE);
+		secq.refs = r;
+		secq.size = size;
+	}
+	secq.refs[secq.len].e = e;
+	secq.refs[secq.len].u = u;
+	secq.len++;
+	secq.mask |= bits_of(e->second, SECOND_COUNT);
+	return (TRUE);
+}
+
+/*
+ * Return the next second of the current minute in which a queued entry
+ * runs, or -1 if there is none.
+ */
+int sched_seconds_next(void) {
+	int s;
+
+	if (secq.mask == 0)
+		return (-1);
+	for (s = secq.done + 1; s < SECOND_COUNT; s++)
+		if (secq.mask & ((uint64_t)1 << s))
+			return (s);
+	return (-1);
+}
+
+/*
+ * Return the next queued entry which runs in one of the seconds after
+ * the last one served, up to second.  Return FALSE when there are no
+ * more; second is then served.
+ */
+int sched_seconds_due(int second, entry **ep, user **up) {
+	uint64_t window;
+
+	if (second <= secq.done)
+		return (FALSE);
+
+	window = ((uint64_t)2 << second) - 1;
+	if (secq.done >= 0)
+		window &= ~(((uint64_t)2 << secq.done) - 1);
+	while (secq.pos < secq.len) {
+		const sched_ref *r = &secq.refs[secq.pos++];
+
+		if (bits_of(r->e->second, SECOND_COUNT) & window) {
+			*ep = r->e;
+			*up = r->u;
+			return (TRUE);
+		}
+	}
+	secq.pos = 0;
+	secq.done = second;
+	return (FALSE);
+}
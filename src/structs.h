@@ -22,19 +22,57 @@
 #ifndef CRONIE_STRUCTS_H
 #define CRONIE_STRUCTS_H
 
+#include <stdint.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #ifdef WITH_SELINUX
 #include <selinux/selinux.h>
 #endif
 #include "macros.h"
 #include "bitstring.h"
 
+			/* timezones named by CRON_TZ, interned by
+			 * load_entry() and never freed.  The last
+			 * broken-down time is kept, so find_jobs()
+			 * converts the time once per zone and minute.
+			 */
+typedef	struct _cron_zone {
+	struct _cron_zone	*next;
+	char		*name;		/* value of CRON_TZ, may be "" */
+	time_t		when;		/* time of tm below, -1 if none */
+	struct tm	tm;
+} cron_zone;
+
+			/* a file read into memory, which the crontab
+			 * parser scans, see read_buf().  The data is
+			 * followed by a NUL.
+			 */
+typedef	struct _cron_buf {
+	char		*data;
+	const char	*p;		/* next character */
+	const char	*end;		/* end of the data */
+} cron_buf;
+
+			/* a crontab of a batch being loaded, see
+			 * uring_open().  What could not be done for
+			 * the whole batch is left to the loader.
+			 */
+typedef	struct _uring_file {
+	const char	*path;
+	int		fd;		/* -1 if it could not be opened */
+	int		stat;		/* st is good */
+	struct stat	st;
+	cron_buf	buf;		/* contents, if data is not NULL */
+} uring_file;
+
 typedef	struct _entry {
 	struct _entry	*next;
 	struct passwd	*pwd;
 	char		**envp;
 	char		*cmd;
+	cron_zone	*tz;		/* CRON_TZ of the entry, or NULL */
+	bitstr_t	bit_decl(second, SECOND_COUNT);	/* if SEC_FIELD */
 	bitstr_t	bit_decl(minute, MINUTE_COUNT);
 	bitstr_t	bit_decl(hour,   HOUR_COUNT);
 	bitstr_t	bit_decl(dom,    DOM_COUNT);
@@ -42,6 +80,9 @@ typedef	struct _entry {
 	bitstr_t	bit_decl(dow,    DOW_COUNT);
 	int		flags;
 	int		delay;
+	int		sched_idx;	/* slot in the run heap, see sched.c */
+	int		order;		/* position in its crontab */
+	unsigned	queued;		/* job queue round, see job.c */
 #define	MIN_STAR	0x01
 #define	HR_STAR		0x02
 #define	DOM_STAR	0x04
@@ -49,6 +90,7 @@ typedef	struct _entry {
 #define	WHEN_REBOOT	0x10
 #define	DONT_LOG	0x20
 #define	MAIL_WHEN_ERR	0x40
+#define	SEC_FIELD	0x80	/* runs at other seconds than 0 */
 } entry;
 
 			/* the crontab database will be a list of the
@@ -61,14 +103,20 @@ typedef	struct _entry {
 #define security_context_t unsigned
 #endif
 
+typedef	struct _cache_rec cache_rec;	/* see cache.c */
+
 typedef	struct _user {
 	struct _user	*next, *prev;	/* links */
+	struct _user	*name_next, *tab_next;	/* hash chains of cron_db */
 	char		*name;
 	char		*tabname;       /* /etc/cron.d/ file name or NULL */
 	time_t		mtime;		/* last modtime of crontab */
+	uint64_t	hash;		/* of its contents, see hash_buf() */
 	entry		*crontab;	/* this person's crontab */
 	security_context_t	scontext;    /* SELinux security context */
 	int		system;		/* is it a system crontab */
+	cache_rec	*cached;	/* record of its last parse, see cache.c */
+	unsigned long	order;		/* position in its database, see link_user() */
 } user;
 
 typedef	struct _orphan {
@@ -84,6 +132,8 @@ typedef	struct _cron_db {
 #ifdef WITH_INOTIFY
 	int		ifd;
 #endif
+	user		**by_name, **by_tab;	/* hash index for find_user() */
+	int		nbuckets, nusers;
 } cron_db;
 				/* in the C tradition, we only create
 				 * variables for the main program, just
@@ -0,0 +1,134 @@
+/*
+    stubs - what cronnext links in place of the parts of crond it does
+    not need: running jobs, scheduling them, the caches and inotify
+    Copyright (C) 2016 Marco Migliori <sgerwk@aol.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ 
+    The GNU General Public License can also be found in the file
+    `COPYING' that comes with the Anacron source distribution.
+*/
+
+#include "config.h"
+
+#include <pwd.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "globals.h"
+#include "funcs.h"
+
+#ifdef WITH_INOTIFY
+void set_cron_watched(int fd) {
+/* empty stub */
+	(void)fd;
+}
+
+const char *cron_watched_path(int w) {
+/* empty stub */
+	(void)w;
+	return NULL;
+}
+
+int cron_watches_missing(void) {
+/* empty stub */
+	return 0;
+}
+#endif
+
+void do_command(entry *e, user *u) {
+/* empty stub */
+	(void)e;
+	(void)u;
+}
+
+void sched_add(entry *e, user *u) {
+/* empty stub */
+	(void)e;
+	(void)u;
+}
+
+void sched_remove(entry *e) {
+/* empty stub */
+	(void)e;
+}
+
+int cache_load(user *u, const struct stat *st, const cron_buf *buf,
+	struct passwd *pw, char ***envpp) {
+/* no cache here */
+	(void)u;
+	(void)st;
+	(void)buf;
+	(void)pw;
+	(void)envpp;
+	return FALSE;
+}
+
+int cache_fresh(const char *tabname, const struct stat *st) {
+/* empty stub */
+	(void)tabname;
+	(void)st;
+	return FALSE;
+}
+
+void cache_record(user *u, const char *envstr, const entry *e) {
+/* empty stub */
+	(void)u;
+	(void)envstr;
+	(void)e;
+}
+
+void cache_rekey(user *u, int fd) {
+/* empty stub */
+	(void)u;
+	(void)fd;
+}
+
+void cache_free(user *u) {
+/* empty stub */
+	(void)u;
+}
+
+void cache_begin(void) {
+/* empty stub */
+}
+
+void cache_end(cron_db *db) {
+/* empty stub */
+	(void)db;
+}
+
+int pwcache_get(const char *name, struct passwd **pwp) {
+/* no cache here */
+	*pwp = getpwnam(name);
+	return (*pwp != NULL);
+}
+
+#ifdef WITH_SELINUX
+int get_security_context(const char *name, int crontab_fd,
+			 security_context_t *rcontext, const char *tabname) {
+/* empty stub */
+	(void)name;
+	(void)crontab_fd;
+	(void)tabname;
+	*rcontext = NULL;
+	return 0;
+}
+
+void free_security_context(security_context_t *scontext) {
+/* empty stub */
+	(void)scontext;
+}
+#endif
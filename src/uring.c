@@ -0,0 +1,304 @@
+/*
+ * Opening, stating and reading a batch of crontabs at once.
+ *
+ * Where the kernel has io_uring, each step is a single system call for
+ * the whole batch, and the disk gets every read of the batch together
+ * rather than one after the other.  The ring is set up the first time
+ * it is needed, with plain system calls, and kept.  If there is no
+ * ring, the files are opened one by one and the rest is left to the
+ * loader, as it is for any file the ring could not do.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/sysmacros.h>
+# include <linux/io_uring.h>
+#endif
+
+#include "funcs.h"
+#include "globals.h"
+
+#ifdef HAVE_IO_URING
+
+#define RING_SIZE	128
+
+static int ring_fd = -1;
+static struct {
+	unsigned	*sq_tail, *sq_mask, *sq_array;
+	unsigned	*cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned	entries;
+} ring;
+
+static int ring_failed;		/* no ring to be had, don't ask again */
+
+static struct statx stx[RING_SIZE];
+
+static int ring_setup(void) {
+	struct io_uring_params p;
+	size_t sq_len, cq_len;
+	char *sq, *cq;
+	void *sqes;
+	int fd;
+
+	if (ring_fd != -1)
+		return (TRUE);
+	if (ring_failed)
+		return (FALSE);
+
+	memset(&p, 0, sizeof p);
+	if ((fd = (int) syscall(__NR_io_uring_setup, RING_SIZE, &p)) < 0) {
+		Debug(DLOAD, ("[%ld] no io_uring: %s\n", (long) getpid(),
+				strerror(errno)));
+		ring_failed = TRUE;
+		return (FALSE);
+	}
+	sq_len = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_SQ_RING);
+	cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		fd, IORING_OFF_CQ_RING);
+	sqes = mmap(NULL, p.sq_entries * sizeof (struct io_uring_sqe),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+		IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+		log_it("CRON", getpid(), "io_uring", "mmap failed", errno);
+		if (sq != MAP_FAILED)
+			munmap(sq, sq_len);
+		if (cq != MAP_FAILED)
+			munmap(cq, cq_len);
+		if (sqes != MAP_FAILED)
+			munmap(sqes, p.sq_entries * sizeof (struct io_uring_sqe));
+		close(fd);
+		ring_failed = TRUE;
+		return (FALSE);
+	}
+
+	ring.sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	ring.sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned *) (sq + p.sq_off.array);
+	ring.cq_head = (unsigned *) (cq + p.cq_off.head);
+	ring.cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	ring.cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+	ring.sqes = sqes;
+	ring.entries = p.sq_entries < RING_SIZE ? p.sq_entries : RING_SIZE;
+	ring_fd = fd;
+	Debug(DLOAD, ("[%ld] io_uring of %u entries\n", (long) getpid(),
+			ring.entries));
+	return (TRUE);
+}
+
+static void stat_from_statx(struct stat *st, const struct statx *x) {
+	memset(st, 0, sizeof *st);
+	st->st_dev = makedev(x->stx_dev_major, x->stx_dev_minor);
+	st->st_ino = (ino_t) x->stx_ino;
+	st->st_mode = (mode_t) x->stx_mode;
+	st->st_nlink = (nlink_t) x->stx_nlink;
+	st->st_uid = (uid_t) x->stx_uid;
+	st->st_gid = (gid_t) x->stx_gid;
+	st->st_rdev = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+	st->st_size = (off_t) x->stx_size;
+	st->st_blksize = (blksize_t) x->stx_blksize;
+	st->st_blocks = (blkcnt_t) x->stx_blocks;
+	st->st_atim.tv_sec = (time_t) x->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = (long) x->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = (time_t) x->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = (long) x->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = (time_t) x->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = (long) x->stx_ctime.tv_nsec;
+}
+
+static void prep(struct io_uring_sqe *sqe, uring_file *f, int op, int i) {
+	memset(sqe, 0, sizeof *sqe);
+	sqe->user_data = (__u64) i;
+	switch (op) {
+	case IORING_OP_OPENAT:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (__u64) (uintptr_t) f->path;
+		sqe->open_flags = O_RDONLY | O_NONBLOCK;
+		break;
+	case IORING_OP_STATX:
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = f->fd;
+		sqe->addr = (__u64) (uintptr_t) "";
+		sqe->len = STATX_BASIC_STATS;
+		sqe->statx_flags = AT_EMPTY_PATH;
+		sqe->off = (__u64) (uintptr_t) &stx[i % RING_SIZE];
+		break;
+	case IORING_OP_READ:
+		/* the extra byte sees a file that grew since it was stated */
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = f->fd;
+		sqe->addr = (__u64) (uintptr_t) f->buf.data;
+		sqe->len = (__u32) f->st.st_size + 1;
+		sqe->off = 0;
+		break;
+	}
+}
+
+static void complete(uring_file *f, int op, int i, int res) {
+	switch (op) {
+	case IORING_OP_OPENAT:
+		f->fd = res >= 0 ? res : -1;
+		break;
+	case IORING_OP_STATX:
+		if ((f->stat = res >= 0))
+			stat_from_statx(&f->st, &stx[i % RING_SIZE]);
+		break;
+	case IORING_OP_READ:
+		if (res < 0 || (off_t) res > f->st.st_size) {
+			free(f->buf.data);
+			f->buf.data = NULL;
+			break;
+		}
+		f->buf.data[res] = '\0';
+		f->buf.p = f->buf.data;
+		f->buf.end = f->buf.data + res;
+		break;
+	}
+}
+
+/*
+ * Do op for the files, ring.entries at a time, and wait for all of it.
+ * If the ring breaks, what was not submitted fails with its error and
+ * the ring is not used again.
+ */
+static void run(uring_file **files, int n, int op) {
+	struct io_uring_cqe *cqe;
+	unsigned tail, head, mask = *ring.sq_mask;
+	int i, k, m, submit, inflight, res, err = 0;
+
+	for (i = 0; i < n && err == 0; i += k) {
+		k = n - i < (int) ring.entries ? n - i : (int) ring.entries;
+		tail = *ring.sq_tail;
+		for (m = 0; m < k; m++) {
+			prep(&ring.sqes[(tail + m) & mask], files[i + m], op, i + m);
+			ring.sq_array[(tail + m) & mask] = (tail + m) & mask;
+		}
+		__atomic_store_n(ring.sq_tail, tail + k, __ATOMIC_RELEASE);
+
+		submit = k;
+		inflight = 0;
+		while (submit > 0 || inflight > 0) {
+			/* once broken, only wait for what is in flight */
+			res = (int) syscall(__NR_io_uring_enter, ring_fd,
+				err == 0 ? submit : 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				if (err != 0 || inflight == 0) {
+					if (err == 0)
+						err = errno;
+					break;
+				}
+				err = errno;
+				continue;
+			}
+			submit -= res;
+			inflight += res;
+
+			head = *ring.cq_head;
+			while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+				cqe = &ring.cqes[head & *ring.cq_mask];
+				m = (int) cqe->user_data;
+				complete(files[m], op, m, cqe->res);
+				head++;
+				inflight--;
+			}
+			__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+			if (err != 0 && inflight == 0)
+				break;
+		}
+		if (err != 0)
+			for (m = k - submit; m < k; m++)
+				complete(files[i + m], op, i + m, -err);
+	}
+	if (err != 0) {
+		log_it("CRON", getpid(), "io_uring", "enter failed", err);
+		close(ring_fd);
+		ring_fd = -1;
+		ring_failed = TRUE;
+		for (; i < n; i++)
+			complete(files[i], op, i, -err);
+	}
+}
+
+#endif /* HAVE_IO_URING */
+
+/* open each of the files, setting fd */
+void uring_open(uring_file **files, int n) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		files[i]->fd = -1;
+		files[i]->stat = FALSE;
+		files[i]->buf.data = NULL;
+	}
+#ifdef HAVE_IO_URING
+	if (ring_setup()) {
+		run(files, n, IORING_OP_OPENAT);
+		return;
+	}
+#endif
+	for (i = 0; i < n; i++)
+		files[i]->fd = open(files[i]->path, O_RDONLY | O_NONBLOCK, 0);
+}
+
+/*
+ * Stat the files that are open, setting st, through the ring only.
+ * files is used as scratch.
+ */
+void uring_stat(uring_file **files, int n) {
+#ifdef HAVE_IO_URING
+	int i, m;
+
+	if (ring_fd == -1)
+		return;
+	for (i = m = 0; i < n; i++)
+		if (files[i]->fd != -1)
+			files[m++] = files[i];
+	run(files, m, IORING_OP_STATX);
+#else
+	(void) files;
+	(void) n;
+#endif
+}
+
+/*
+ * Read the files, which are stated regular files, into buf, through the
+ * ring only.  The data is the caller's to free; files is used as
+ * scratch.
+ */
+void uring_read(uring_file **files, int n) {
+#ifdef HAVE_IO_URING
+	uring_file *f;
+	int i, m;
+
+	if (ring_fd == -1)
+		return;
+	for (i = m = 0; i < n; i++) {
+		f = files[i];
+		if (f->st.st_size >= 0 && f->st.st_size < INT32_MAX &&
+			(f->buf.data = malloc((size_t) f->st.st_size + 2)) != NULL)
+			files[m++] = f;
+	}
+	run(files, m, IORING_OP_READ);
+#else
+	(void) files;
+	(void) n;
+#endif
+}
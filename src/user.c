@@ -27,12 +27,17 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "funcs.h"
 #include "globals.h"
 
-static const char *FileName;
+static THREAD_LOCAL const char *FileName;
+
+#ifdef WITH_SELINUX
+DEFINE_LOCK(selinux_lock);	/* libselinux is not known to be thread safe */
+#endif
 
 static void
 log_error (const char *msg)
@@ -50,8 +55,10 @@ free_user (user * u) {
 
 	free(u->name);
 	free(u->tabname);
+	cache_free(u);
 	for (e = u->crontab; e != NULL; e = ne)	{
 		ne = e->next;
+		sched_remove(e);
 		free_entry(e);
 	}
 #ifdef WITH_SELINUX
@@ -63,24 +70,39 @@ free_user (user * u) {
 user *
 load_user (int crontab_fd, struct passwd *pw, const char *uname,
 		   const char *fname, const char *tabname) {
+	return (load_user_read(crontab_fd, NULL, NULL, pw, uname, fname,
+			tabname));
+}
+
+/*
+ * load_user() for a crontab that may have been stated as *st and read
+ * into *in already; those not done are NULL, or in->data is.  The data
+ * of in is taken over.
+ */
+user *
+load_user_read (int crontab_fd, const struct stat *st, cron_buf *in,
+		struct passwd *pw, const char *uname, const char *fname,
+		const char *tabname) {
 	char envstr[MAX_ENVSTR];
-	FILE *file;
+	cron_buf buf, *file = &buf;
+	struct stat statbuf;
 	user *u;
 	entry *e;
 	int status = TRUE, save_errno = 0;
 	char **envp = NULL, **tenvp;
-	int envs = 0, entries = 0;
+	int envs = 0, entries = 0, cached;
+#ifdef WITH_SELINUX
+	int context_ok;
+#endif
 
-	if (!(file = fdopen(crontab_fd, "r")))	{
-		save_errno = errno;
-		log_it(uname, getpid (), "FAILED", "fdopen on crontab_fd in load_user",
-			save_errno);
-		close(crontab_fd);
-		return (NULL);
+	buf.data = NULL;
+	if (in != NULL && in->data != NULL) {
+		buf = *in;
+		in->data = NULL;
 	}
-
 	Debug(DPARS, ("load_user()\n"));
-	/* file is open.  build user entry, then read the crontab file.
+	/* file is open.  build user entry, then read the crontab file,
+	 * unless the cache has it.
 	 */
 	if ((u = (user *) malloc (sizeof (user))) == NULL) {
 		save_errno = errno;
@@ -109,11 +131,34 @@ load_user (int crontab_fd, struct passwd *pw, const char *uname,
 	}
 
 #ifdef WITH_SELINUX
-	if (get_security_context(pw == NULL ? NULL : uname,
-		crontab_fd, &u->scontext, tabname) != 0) {
+	LOCK(&selinux_lock);
+	context_ok = get_security_context(pw == NULL ? NULL : uname,
+		crontab_fd, &u->scontext, tabname) == 0;
+	UNLOCK(&selinux_lock);
+	if (!context_ok)
 		goto done;
-	}
 #endif
+	if (st != NULL)
+		statbuf = *st;
+	else if (fstat(crontab_fd, &statbuf) < OK) {
+		save_errno = errno;
+		goto done;
+	}
+	if ((cached = cache_load(u, &statbuf, NULL, pw, &envp)) == FALSE) {
+		if (buf.data == NULL && read_buf(crontab_fd, file) != OK) {
+			save_errno = errno;
+			log_it(uname, getpid (), "FAILED",
+				"reading crontab_fd in load_user", save_errno);
+			goto done;
+		}
+		u->hash = hash_buf(file);
+		cached = cache_load(u, &statbuf, file, pw, &envp);
+	}
+	if (cached != FALSE) {
+		if (cached == TRUE)
+			status = FALSE;
+		goto done;
+	}
 	/* load the crontab
 	*/
 	while (status >= OK) {
@@ -146,6 +191,7 @@ load_user (int crontab_fd, struct passwd *pw, const char *uname,
 				if (e) {
 					e->next = u->crontab;
 					u->crontab = e;
+					cache_record(u, NULL, e);
 				}
 				break;
 			case TRUE:
@@ -159,6 +205,7 @@ load_user (int crontab_fd, struct passwd *pw, const char *uname,
 					goto done;
 				}
 				envp = tenvp;
+				cache_record(u, envstr, NULL);
 				break;
 		}
 	}
@@ -172,8 +219,28 @@ done:
 	}
 	if (envp)
 		env_free(envp);
-	fclose(file);
+	free(buf.data);
+	close(crontab_fd);
 	Debug(DPARS, ("...load_user() done\n"));
 	errno = save_errno;
 	return (u);
 }
+
+/*
+ * Does the crontab open as fd have the contents u was loaded from?  The
+ * file is rewound afterwards, for load_user().  Only regular files are
+ * looked at, others can't be read twice.
+ */
+int
+same_crontab(int fd, const user * u) {
+	struct stat statbuf;
+	cron_buf buf;
+	int same;
+
+	if (fstat(fd, &statbuf) < OK || !S_ISREG(statbuf.st_mode))
+		return (FALSE);
+	same = read_buf(fd, &buf) == OK && hash_buf(&buf) == u->hash;
+	free(buf.data);
+	(void) lseek(fd, 0, SEEK_SET);
+	return (same);
+}
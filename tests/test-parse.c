@@ -0,0 +1,292 @@
+/*
+ * Checks of the crontab parser reading from a cron_buf: get_string(),
+ * skip_comments() and its MAX_GARBAGE limit, load_env(), load_entry(),
+ * NUL bytes in the file and the line numbers errors are reported at.
+ */
+
+#include "config.h"
+
+#define MAIN_PROGRAM
+
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "globals.h"
+#include "funcs.h"
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, \
+				#cond); \
+			failures++; \
+		} \
+	} while (0)
+
+static int failures;
+
+static struct passwd pw;
+static char **envp;
+
+static int error_lines[8], nerrors;
+
+/* as crontab(1) does, the line is the one just read */
+static void record_error(const char *msg) {
+	(void) msg;
+	if (nerrors < (int) (sizeof error_lines / sizeof error_lines[0]))
+		error_lines[nerrors] = LineNumber - 1;
+	nerrors++;
+}
+
+/* make b hold the len bytes at s, followed by a NUL as read_buf() does */
+static void set_buf(cron_buf *b, const char *s, size_t len) {
+	free(b->data);
+	if ((b->data = malloc(len + 1)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	memcpy(b->data, s, len);
+	b->data[len] = '\0';
+	b->p = b->data;
+	b->end = b->data + len;
+}
+
+static void set_str(cron_buf *b, const char *s) {
+	set_buf(b, s, strlen(s));
+}
+
+static void check_get_string(void) {
+	static const char nul[] = "ab\0cd\n";
+	cron_buf b = { NULL, NULL, NULL };
+	char s[100];
+
+	set_str(&b, "first line\nsecond");
+	LineNumber = 1;
+	CHECK(get_string(s, sizeof s, &b, "\n") == '\n');
+	CHECK(strcmp(s, "first line") == 0);
+	CHECK(LineNumber == 2);
+	CHECK(get_string(s, sizeof s, &b, "\n") == EOF);
+	CHECK(strcmp(s, "second") == 0);
+	CHECK(LineNumber == 2);
+	CHECK(b.p == b.end);
+
+	/* too long: cut, but read up to the terminator all the same */
+	set_str(&b, "abcdefgh\nnext\n");
+	CHECK(get_string(s, 5, &b, "\n") == '\n');
+	CHECK(strcmp(s, "abcd") == 0);
+	CHECK(strncmp(b.p, "next", 4) == 0);
+
+	set_str(&b, "word\trest\n");
+	CHECK(get_string(s, sizeof s, &b, " \t\n") == '\t');
+	CHECK(strcmp(s, "word") == 0);
+
+	/* a NUL ends the string; the rest is read next */
+	set_buf(&b, nul, sizeof nul - 1);
+	LineNumber = 1;
+	CHECK(get_string(s, sizeof s, &b, "\n") == '\0');
+	CHECK(strcmp(s, "ab") == 0);
+	CHECK(get_string(s, sizeof s, &b, "\n") == '\n');
+	CHECK(strcmp(s, "cd") == 0);
+	CHECK(LineNumber == 2);
+	CHECK(get_string(s, sizeof s, &b, "\n") == EOF);
+
+	free(b.data);
+}
+
+/* count the newlines of the first len bytes at s */
+static int newlines(const char *s, size_t len) {
+	int n = 0;
+
+	while (len-- > 0)
+		if (*s++ == '\n')
+			n++;
+	return (n);
+}
+
+static void check_skip_comments(void) {
+	cron_buf b = { NULL, NULL, NULL };
+	char *garbage;
+	size_t len;
+
+	set_str(&b, "# one\n\n   \n\t# two\n* * * * * x\n");
+	LineNumber = 1;
+	CHECK(skip_comments(&b));
+	CHECK(strncmp(b.p, "* * * * * x", 11) == 0);
+	CHECK(LineNumber == 5);
+
+	set_str(&b, "# one\n# two");
+	LineNumber = 1;
+	CHECK(skip_comments(&b));
+	CHECK(b.p == b.end);
+	CHECK(LineNumber == 2);
+
+	set_str(&b, "  0 1 * * * x\n");
+	CHECK(skip_comments(&b));
+	CHECK(b.p == b.data + 2);
+
+	/* just under MAX_GARBAGE of comment is fine */
+	len = MAX_GARBAGE + 100;
+	if ((garbage = malloc(len + 1)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(garbage, 'x', len);
+	garbage[0] = '#';
+	garbage[MAX_GARBAGE - 2] = '\n';
+	strcpy(garbage + MAX_GARBAGE - 1, "* * * * * x\n");
+	set_str(&b, garbage);
+	LineNumber = 1;
+	CHECK(skip_comments(&b));
+	CHECK(b.p == b.data + MAX_GARBAGE - 1);
+	CHECK(LineNumber == 2);
+
+	/* at MAX_GARBAGE it stops there, still counting the lines */
+	memset(garbage, '\n', len);
+	memcpy(garbage, "# many lines\n", 13);
+	memcpy(garbage + 100, "# more\n# more\n", 14);
+	garbage[len - 1] = '\n';
+	garbage[len] = '\0';
+	set_str(&b, garbage);
+	LineNumber = 1;
+	CHECK(!skip_comments(&b));
+	CHECK(b.p == b.data + MAX_GARBAGE);
+	CHECK(LineNumber == 1 + newlines(b.data, MAX_GARBAGE));
+
+	free(garbage);
+	free(b.data);
+}
+
+static void check_load_env(void) {
+	cron_buf b = { NULL, NULL, NULL };
+	char envstr[MAX_ENVSTR];
+
+	set_str(&b, "A=1\nB = 'x y'\n* * * * * cmd\n");
+	LineNumber = 1;
+	CHECK(load_env(envstr, &b) == TRUE);
+	CHECK(strcmp(envstr, "A=1") == 0);
+	CHECK(load_env(envstr, &b) == TRUE);
+	CHECK(strcmp(envstr, "B=x y") == 0);
+	CHECK(LineNumber == 3);
+
+	/* not a setting: left for load_entry() */
+	CHECK(load_env(envstr, &b) == FALSE);
+	CHECK(strncmp(b.p, "* * * * * cmd", 13) == 0);
+	CHECK(LineNumber == 3);
+
+	/* no newline at the end */
+	set_str(&b, "C=3");
+	CHECK(load_env(envstr, &b) == ERR);
+	CHECK(strcmp(envstr, "C=3") == 0);
+
+	free(b.data);
+}
+
+/*
+ * Parse b as load_user() does, into at most max entries.  Return the
+ * number of entries, or -1 if there was too much garbage.  *tail is
+ * what is left of a last line without a newline.
+ */
+static int parse_crontab(cron_buf *b, entry **entries, int max, char *tail) {
+	char envstr[MAX_ENVSTR];
+	int status, n = 0;
+	entry *e;
+
+	LineNumber = 1;
+	nerrors = 0;
+	for (;;) {
+		if (!skip_comments(b))
+			return (-1);
+		if ((status = load_env(envstr, b)) == ERR)
+			break;
+		if (status == FALSE &&
+			(e = load_entry(b, record_error, &pw, envp)) != NULL &&
+			n < max)
+			entries[n++] = e;
+	}
+	strcpy(tail, envstr);
+	return (n);
+}
+
+static void check_crontab(void) {
+	static const char tab[] =
+		"# a crontab\n"					/* 1 */
+		"SHELL=/bin/sh\n"				/* 2 */
+		"\n"						/* 3 */
+		"0 5 * * * first\n"				/* 4 */
+		"bad entry here\n"				/* 5 */
+		"*/10 1-3 * jan-mar mon,fri second\n"		/* 6 */
+		"1 2 * * * echo a\0b\n"				/* 7 */
+		"@daily third\n"				/* 8 */
+		"   # indented comment\n"			/* 9 */
+		"61 * * * * out of range\n"			/* 10 */
+		"0 0 * foo * no such month\n"			/* 11 */
+		"last without newline";				/* 12 */
+	cron_buf b = { NULL, NULL, NULL };
+	char tail[MAX_ENVSTR];
+	entry *entries[8];
+	int i, n;
+
+	set_buf(&b, tab, sizeof tab - 1);
+	n = parse_crontab(&b, entries, 8, tail);
+	CHECK(n == 4);
+	if (n != 4)
+		return;
+
+	CHECK(strcmp(entries[0]->cmd, "first") == 0);
+	CHECK(bit_test(entries[0]->minute, 0) && bit_test(entries[0]->hour, 5));
+
+	CHECK(strcmp(entries[1]->cmd, "second") == 0);
+	for (i = FIRST_MINUTE; i <= LAST_MINUTE; i++)
+		CHECK(!bit_test(entries[1]->minute, i) == (i % 10 != 0));
+	for (i = FIRST_HOUR; i <= LAST_HOUR; i++)
+		CHECK(!bit_test(entries[1]->hour, i) == (i < 1 || i > 3));
+	for (i = FIRST_MONTH; i <= LAST_MONTH; i++)
+		CHECK(!bit_test(entries[1]->month, i - FIRST_MONTH) == (i > 3));
+	CHECK(bit_test(entries[1]->dow, 1) && bit_test(entries[1]->dow, 5) &&
+		!bit_test(entries[1]->dow, 0));
+	CHECK(!(entries[1]->flags & DOW_STAR) && (entries[1]->flags & DOM_STAR));
+
+	/* the NUL ends the command, and what follows it is no entry */
+	CHECK(strcmp(entries[2]->cmd, "echo a") == 0);
+
+	CHECK(strcmp(entries[3]->cmd, "third") == 0);
+	CHECK(bit_test(entries[3]->minute, 0) && bit_test(entries[3]->hour, 0));
+
+	/* errors are reported at their own line */
+	CHECK(nerrors == 4);
+	CHECK(error_lines[0] == 5);
+	CHECK(error_lines[1] == 7);
+	CHECK(error_lines[2] == 10);
+	CHECK(error_lines[3] == 11);
+
+	/* a last line without a newline is not parsed, see load_user() */
+	CHECK(strcmp(tail, "last without newline") == 0);
+	CHECK(LineNumber == 12);
+
+	for (i = 0; i < n; i++)
+		free_entry(entries[i]);
+	free(b.data);
+}
+
+int main(void) {
+	pw.pw_name = "tester";
+	pw.pw_passwd = "x";
+	pw.pw_uid = pw.pw_gid = 1000;
+	pw.pw_gecos = "";
+	pw.pw_dir = "/tmp";
+	pw.pw_shell = "/bin/sh";
+	if ((envp = env_init()) == NULL) {
+		perror("env_init");
+		return (1);
+	}
+
+	check_get_string();
+	check_skip_comments();
+	check_load_env();
+	check_crontab();
+
+	env_free(envp);
+	return (failures != 0);
+}
@@ -0,0 +1,240 @@
+/*
+ * Checks of the scheduler in src/sched.c: the next run of an entry, and
+ * the entries the heap hands to find_jobs() minute after minute, which
+ * have to be those that match, in the order of the database.
+ */
+
+#include "config.h"
+
+#define MAIN_PROGRAM
+
+#include <limits.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "globals.h"
+#include "funcs.h"
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, \
+				#cond); \
+			failures++; \
+		} \
+	} while (0)
+
+static int failures;
+
+static struct passwd pw;
+static char **envp;
+
+static void parse_error(const char *msg) {
+	fprintf(stderr, "parse error: %s\n", msg);
+	failures++;
+}
+
+static entry *parse(const char *line, int order) {
+	cron_buf buf;
+	entry *e;
+
+	buf.data = strdup(line);
+	buf.p = buf.data;
+	buf.end = buf.data + strlen(line);
+	e = load_entry(&buf, parse_error, &pw, envp);
+	free(buf.data);
+	if (e == NULL) {
+		fprintf(stderr, "can't parse: %s", line);
+		exit(1);
+	}
+	e->order = order;
+	return (e);
+}
+
+/* the virtual minute of a time in UTC */
+static int vminute(int year, int mon, int mday, int hour, int min) {
+	struct tm tm;
+
+	memset(&tm, 0, sizeof tm);
+	tm.tm_year = year - 1900;
+	tm.tm_mon = mon - 1;
+	tm.tm_mday = mday;
+	tm.tm_hour = hour;
+	tm.tm_min = min;
+	return ((int) (timegm(&tm) / SECONDS_PER_MINUTE));
+}
+
+/* does e run in vtime?  The test of find_jobs(), written out */
+static int runs_at(const entry *e, int vtime) {
+	time_t t = (time_t) vtime * SECONDS_PER_MINUTE;
+	struct tm tm;
+	int dom, dow;
+
+	gmtime_r(&t, &tm);
+	dom = bit_test(e->dom, tm.tm_mday - FIRST_DOM);
+	dow = bit_test(e->dow, tm.tm_wday - FIRST_DOW);
+	return (bit_test(e->minute, tm.tm_min - FIRST_MINUTE) &&
+		bit_test(e->hour, tm.tm_hour - FIRST_HOUR) &&
+		bit_test(e->month, tm.tm_mon + 1 - FIRST_MONTH) &&
+		((e->flags & (DOM_STAR | DOW_STAR)) ? dom && dow : dom || dow));
+}
+
+static void check_next_run(const char *line, int from, int want) {
+	user u;
+	entry *e;
+
+	memset(&u, 0, sizeof u);
+	e = parse(line, 0);
+	sched_add(e, &u);
+	if (sched_next(from) != want) {
+		fprintf(stderr, "next run of %s from %d: %d, not %d\n", line, from,
+			sched_next(from), want);
+		failures++;
+	}
+	sched_remove(e);
+	free_entry(e);
+}
+
+static const char *const lines[] = {
+	"*/7 * * * * a\n",
+	"0 * * * * b\n",
+	"30 2 * * * c\n",
+	"15 0 29 2 * d\n",
+	"0 12 1 * 5 e\n",
+	"5 4 * * sun f\n",
+	"*/20 9-17 * * 1-5 g\n",
+	"0 0 30 2 * h\n",
+	"45 23 28-31 * * i\n",
+	"59 23 * 2 * j\n",
+	"0,30 * 1 3 * k\n",
+	"10 10 * * * l\n",
+	"58,59 * * * * m\n",
+};
+#define NLINES	(int) (sizeof lines / sizeof lines[0])
+#define NUSERS	3
+
+static entry *entries[NLINES];
+static user users[NUSERS];
+
+static int due_at(int vtime) {
+	int i, n = 0;
+
+	for (i = 0; i < NLINES; i++)
+		if (entries[i] != NULL && runs_at(entries[i], vtime))
+			n++;
+	return (n);
+}
+
+/* walk what sched_due() or sched_scan() prepared for vtime */
+static int walk(int vtime, int exact) {
+	entry *e, *pe = NULL;
+	user *u, *pu = NULL;
+	int n = 0, matched = 0;
+
+	while (sched_scan_next(&e, &u)) {
+		n++;
+		if (runs_at(e, vtime))
+			matched++;
+		else
+			CHECK(!exact);
+		if (pu != NULL)
+			CHECK(pu->order < u->order ||
+				(pu == u && pe->order < e->order));
+		pe = e;
+		pu = u;
+	}
+	CHECK(matched == due_at(vtime));
+	return (n);
+}
+
+static void check_heap(void) {
+	int start = vminute(2024, 2, 27, 22, 50);
+	int end = vminute(2024, 3, 4, 0, 0);
+	int removed = vminute(2024, 3, 1, 12, 0);
+	int i, v, m, next, last = start, minutes = 0, ran = 0;
+
+	/* users in the database out of the order of their crontabs */
+	users[0].order = 3;
+	users[1].order = 1;
+	users[2].order = 2;
+	for (i = 0; i < NLINES; i++) {
+		entries[i] = parse(lines[i], i / NUSERS);
+		sched_add(entries[i], &users[i % NUSERS]);
+	}
+
+	for (v = start; v < end; v = next + 1) {
+		if (entries[1] != NULL && v >= removed) {
+			/* a hole in the middle of the heap */
+			sched_remove(entries[1]);
+			free_entry(entries[1]);
+			entries[1] = NULL;
+		}
+		next = sched_next(v);
+		CHECK(next >= v);
+		for (m = v; m < next && m < end; m++)
+			CHECK(due_at(m) == 0);
+		if (next >= end)
+			break;
+		CHECK(sched_claim(next));
+		CHECK(sched_due(next, 0L));
+		ran += walk(next, TRUE);
+		minutes++;
+		last = next;
+	}
+	CHECK(minutes > 0 && ran >= minutes);
+
+	/* minutes revisited after a time change come from the index */
+	for (v = start; v <= last; v += 13) {
+		CHECK(!sched_claim(v));
+		CHECK(sched_scan(v, 0L, TRUE));
+		walk(v, FALSE);
+	}
+
+	for (i = 0; i < NLINES; i++)
+		if (entries[i] != NULL) {
+			sched_remove(entries[i]);
+			free_entry(entries[i]);
+		}
+	CHECK(sched_next(start) == INT_MAX);
+}
+
+int main(void) {
+	setenv("TZ", "UTC", 1);
+	tzset();
+	pw.pw_name = "tester";
+	pw.pw_passwd = "x";
+	pw.pw_uid = pw.pw_gid = 1000;
+	pw.pw_gecos = "";
+	pw.pw_dir = "/tmp";
+	pw.pw_shell = "/bin/sh";
+	if ((envp = env_init()) == NULL) {
+		perror("env_init");
+		return (1);
+	}
+
+	check_next_run("*/15 * * * * x\n", vminute(2024, 1, 1, 0, 7),
+		vminute(2024, 1, 1, 0, 15));
+	check_next_run("*/15 * * * * x\n", vminute(2024, 1, 1, 0, 15),
+		vminute(2024, 1, 1, 0, 15));
+	check_next_run("59 23 31 12 * x\n", vminute(2024, 1, 1, 0, 0),
+		vminute(2024, 12, 31, 23, 59));
+	check_next_run("15 0 29 2 * x\n", vminute(2025, 3, 1, 0, 0),
+		vminute(2028, 2, 29, 0, 15));
+	/* the 13th, or any Friday */
+	check_next_run("0 12 13 * 5 x\n", vminute(2024, 6, 8, 0, 0),
+		vminute(2024, 6, 13, 12, 0));
+	check_next_run("0 12 13 * 5 x\n", vminute(2024, 6, 13, 12, 1),
+		vminute(2024, 6, 14, 12, 0));
+	/* the 13th of any month */
+	check_next_run("0 12 13 * * x\n", vminute(2024, 6, 13, 12, 1),
+		vminute(2024, 7, 13, 12, 0));
+	check_next_run("0 0 30 2 * x\n", vminute(2024, 1, 1, 0, 0), INT_MAX);
+
+	check_heap();
+
+	env_free(envp);
+	return (failures != 0);
+}